@@ -18,6 +18,188 @@
      tend to become a mix of current representation and distracting item) and refreshing
      (they tend to be more similar to the LTM representation)
      A parameter control the level of overlap between items and distractors (called ido)
+  VERSION THREADS :
+     Replications can be run in parallel (threads <value>). Each worker thread owns a trial
+     context holding the matrices, the time and distractor counters and its random stream.
+     Partial results of the workers are summed at the end. Compile with -pthread.
+  VERSION WORK STEALING :
+     The replications of all the points are one sequence of tasks. Each worker owns a range of
+     it, takes tasks from its front and, when it is empty, steals the back half of the largest
+     range left (compare-and-swap on the range, no lock). Task sizes follow the measured time of
+     a replication of the point (about taskDuration of work), and the results of the points are
+     summed with atomic additions. Results do not depend on which worker runs which task.
+  VERSION RNG :
+     rand() is replaced by a xoshiro256** generator. Each replication draws from its own stream
+     (the seed stream jumped once per replication), and Gaussian numbers are produced in batches
+     by a Box-Muller filling a buffer. determ <seed> gives the same results whatever the number
+     of threads.
+  VERSION EMBEDDING STORE :
+     Embeddings are read once at startup instead of once per list length, from the text export
+     of the notebook or from a binary file (header + raw little-endian floats) which is memory
+     mapped (embeddings <file>).
+  VERSION VOCABULARY :
+     A binary embedding file can end with its vocabulary (the word of each row). words <list>
+     takes the memoranda from the rows of the given words instead of the first rows, and draw 1
+     draws the memoranda of each trial at random among these words (all the rows of the file
+     without words <list>). Only the rows used are read from the mapping.
+  VERSION RUNTIME DIMENSIONS :
+     The numbers of memoranda, distractors, positions and item units are runtime parameters
+     (the number of item units defaults to the dimensions of a binary embedding file). The
+     matrices of a context are carved out of one 64-byte aligned block on the heap.
+  VERSION SIMD ACTIVATION :
+     The activations of all items at a position are computed in one pass by a vectorized
+     kernel (AVX-512, AVX2 or NEON when the compiler targets them, e.g. -march=native, scalar
+     otherwise), with the retrieval noise drawn in bulk and the maximum found in the same loop.
+  VERSION SPARSE POSITIONS :
+     A position is stored as the list of its nbUnitBlocks active units (one per block) instead of
+     a dense vector of nbPositionUnits 0/1 units. Activations and encoding only touch the active
+     units, so their cost depends on the number of blocks, not on their size. The activations of
+     several items are computed at once with gather instructions (AVX-512, AVX2).
+  VERSION NEAREST LTM ITEM :
+     The LTM item closest to the retrieved WM item is found by comparing squared distances
+     (vectorized, the sum is abandoned as soon as it exceeds the best distance so far) instead of
+     RMSEs. Two other methods can be chosen (nearest <method>): "norms" uses squared norms of the
+     LTM items computed when they are created and one dot product per item, "prefix" is an
+     approximate search for large vocabularies, which refines the exact distance only for the
+     items closest on the first dimensions (the principal components of the PCA embeddings).
+  VERSION LAZY DECAY :
+     Decay no longer sweeps the whole item x position matrix. The context keeps the product of
+     all the decay factors so far, and each row of the matrix the value of that product when it
+     was last brought up to date. Activations are scaled by the ratio of the two, and a row is
+     brought up to date only when it is modified.
+  VERSION ALIGNED LAYOUT :
+     Units are indexed from 0 and the rows of the matrices are padded with zeros to a multiple
+     of 16 floats, so that every row starts on a cache line and vector loops run over whole rows
+     without tails. Item numbers are unchanged (row 0 is the "no item" row). The rows of the
+     distractors are initialized when the distractors appear, so that a trial only touches the
+     items in use (the active prefix 1..maxMemoranda+distractorNumber).
+  VERSION SWEEP :
+     The model parameters are gathered in a structure, and each context has the parameters of
+     the point it simulates. In sweep mode (grid <param> <values>, points <file>), the points
+     are simulated in one run: the embeddings are loaded once, and (point, range of
+     replications) jobs are run by the worker threads. One line of results is printed per point.
+  VERSION RESULTS SINK :
+     The recall of each replication is written in a buffer of the worker instead of stderr. The
+     buffers are merged at the end in the order of the replications. With results <prefix>, the
+     recalls go to <prefix>.trials.csv (or .trials.bin, format binary) and the results of each point
+     to <prefix>.points.csv. The embeddings and the other startup messages are only displayed in
+     verbose mode.
+  VERSION TRACE BUILD :
+     The trace of the verbose mode can be removed at compile time with -DTBRS_TRACE=0: VERBOSE
+     is then the constant 0, so retrieval, encoding, refreshing, processing and recall carry no
+     trace test and no trace buffer. -v is refused by such a build. The default build (TBRS_TRACE=1)
+     keeps the verbose mode for debugging single trials.
+  VERSION EVENT TRACE :
+     events <file> records the dynamics of sampled trials (one replication every sample <N>) in a
+     binary file: encodings, refreshings, distractor interferences, retrievals, decays, processings
+     and recalls, with the time of the trial. The events of a trial are kept in a ring buffer of
+     the context and written with the recalls. Untraced trials only test a flag. The file is read
+     by load_tbrs_events() in the notebook.
+  VERSION BATCH :
+     batch <B> makes each worker run its replications by batches of B trials in lockstep. The
+     matrices of the B trials are stored lane after lane in one block, the steps of the stimulus
+     are applied to every lane in turn, and the refreshes (whose length differs between trials)
+     run in masked rounds of one retrieval and reencoding per lane. Results are the same for
+     any B.
+  VERSION CUDA :
+     device cuda runs the replications on the GPU, one trial per thread (see tbrs_cuda.cu, which
+     explains how to build it). Compile with -DTBRS_CUDA and link tbrs_cuda.o. The GPU engine is
+     behind the same interface as the CPU one (runReplicationsOnDevice) and gives back the recalls,
+     which are written and counted as usual.
+  VERSION SCHEDULE :
+     the stimulus of a point is compiled once into a schedule of typed operations (encode item i
+     at position p, process distractor d with free time f, recall) which the trials run without
+     decoding symbols. There is no limit of 26 items or 16 operations any more, and design n1,n2,...
+     gives the number of operations after each item (cycled over the list) instead of nbop. Recalls
+     are item numbers; the results files still code them A..Z, '*' for other items.
+  VERSION REFRESH CACHES :
+     Retrievals reuse what has not changed since the previous ones. The context stamps each change
+     of a row of associations, of a WM representation and of the LTM representations. The
+     activations of the items at a position are cached before decay and only the rows changed
+     since are summed again, and the closest LTM item of a WM item is kept until that WM item or
+     the LTM items change. Results are the same as without the caches.
+  VERSION DISTRACTOR PATTERNS :
+     New items copy a ready-made "not characterized" pattern held in the arena of the context,
+     with its norm. Distractor patterns are built in a scratch row of the arena and only replace
+     the LTM representation if they differ from it. The closest LTM items are searched again only
+     if the items they were compared with change: a new distractor is compared with the closest
+     item found so far instead of restarting the whole search.
+  VERSION FIT :
+     fit <param>[:min:max],... searches the values of continuous parameters whose serial position
+     curve is closest (RMSE) to target <p1,p2,...> with a Nelder-Mead simplex, in one run. All the
+     candidates use the same random streams (common random numbers), and a candidate which has
+     to beat a vertex of the simplex is first run on part of the replications and dropped if it
+     is clearly worse.
+  VERSION SPAN :
+     Without a sweep or a fit, the run estimates the span: lists of 1 to nbmemo items are the
+     points of one run (each length with its own number of items, which the previous loop over
+     the lengths did not set), so the lengths are run in parallel and share the embeddings, the
+     contexts and the random streams. The lengths whose proportion correct is at floor or ceiling
+     after the first quarter of the replications are not run further (spanStop 0 runs them all).
+  VERSION COMPILED PARAMETERS :
+     Everything that only depends on the parameters of a point (the logarithms of the refreshing
+     and processing criteria, the scale of the retrieval noise) is computed once by
+     prepareParameters(). fastMath 1 computes the decay factors and the encoding strengths with a
+     polynomial exponential whose relative error is below fastExpBound (checked by bench, which
+     also reports the change of the reference results); the default keeps the exp() of the C library.
+  VERSION STORAGE PRECISION :
+     precision bf16|fp16|int8 keeps a copy of the LTM representations in 16 or 8 bits (int8 with
+     one scale per item), which the search of the closest LTM item reads instead of the floats:
+     the rows it scans take half or a quarter of the cache. Codes are decoded to floats and
+     distances are summed in floats. The WM representations stay in floats, as the small steps
+     of interference would be lost in 16 bits. validate runs the point in fp32 and at the
+     precision with the same streams and reports the change of the results.
+  VERSION CHECKPOINTS :
+     shard <i/N> runs the i-th of N ranges of the points of a sweep (point numbers stay those of the
+     whole sweep). checkpoint <file> runs the replications of the points in rounds and saves the
+     results, the seed and the number of replications done after each one (about every
+     checkpointInterval seconds). A run given the checkpoint of an interrupted one goes on from
+     it. merge <file1,file2,...> combines the checkpoints of the shards into the results of the sweep.
+     The shards must all be run with the same determ <seed> (shard i/N with N>1 needs one) and the
+     same settings: a checkpoint records the seed and a hash of the settings of the engine (units,
+     items, memoranda, interference, processing, nearest, precision, fastMath...), and resume and
+     merge refuse a checkpoint of other ones.
+  VERSION INTERFERENCE MODELS :
+     interfere() is a masked kernel (AVX-512, AVX2, NEON, SSE2 or scalar) with no branch on the -1
+     units. interference <model> chooses how distractors interfere at runtime: overlap (the
+     pattern of createOverlapingRandomPattern: as many units as the known units of the WM item
+     retrieved at the position, shifted by (1-ido) of them, noisy copies of the item units, then
+     shuffled; the prefix of the pattern used to cover all the units with -1, so that distractors
+     carried no item information), similar (a noisy copy of the WM item retrieved at the position)
+     or memoranda (overlap, and each new memorandum also interferes with all the items in WM, by
+     interferenceWeight, in one update blocked by units).
+  VERSION VARIANTS :
+     This file is the engine of both models. reproduce_tbrs_code.c builds it with TBRS_CLASSIC=1,
+     the defaults of the classic TBRS* model (16 positions, 30 distractors, 64 item units, memoranda
+     on a quarter of the units, distractor weight .2). The variants are also runtime options:
+     items <embeddings|random|classic>, interference classic, processing <normal|autopilot> (the
+     distractor of a step is created and interferes at the last position, as in normal
+     processing, and is then also associated with the other positions of the list) and
+     dw <value>. The kernels over the
+     item units are specialized for the usual numbers of units (64, 100, 768), with a generic one
+     for the other numbers.
+  VERSION PROFILE :
+     profile 1 counts the calls of encode, refresh, processing, recall, retrieve, decay, interfere
+     and the closest LTM item search, and times them with the time stamp counter (clock_gettime
+     where there is none). It also counts the retrievals below theta, the distractor patterns
+     created and the lookups of the closest LTM item cache. The counts of each lane are added to
+     the point after each job and displayed per trial after the results of the point. The times
+     include the nested phases (a refresh includes its retrieval and its encoding). Without
+     profile, each phase only tests a flag, and -DTBRS_PROFILE=0 removes even that. A build with
+     -DTBRS_ITT (link -littnotify) marks the phases as ITT tasks for VTune, one with -DTBRS_SDT
+     (sys/sdt.h) as USDT probes tbrs:phase_begin and tbrs:phase_end for perf probe.
+  VERSION SERVER :
+     serve <-|path> is a long-running mode for the many small queries of the notebook and the
+     dashboard: the embeddings are loaded and the contexts of the workers allocated once, then
+     parameter points are read as binary requests from stdin or the clients of a Unix socket,
+     and the results of each one are written back as a binary response (see SERVER). The
+     requests that arrive together are run as the points of one run of the worker pool. The
+     notebook has a client (query_tbrs_server).
+  VERSION BENCHMARK :
+     bench times retrieve, encode, decay, interfere, the search of the closest LTM item and the
+     creation of distractor patterns (ns/call), and whole trials (trials/s), at several numbers of
+     item units, distractors and operations, with a fixed seed. It then runs reference points and
+     fails if their proportion correct or serial positions have changed.
 */
 
 #include <stdio.h>
@@ -25,19 +207,80 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#ifdef TBRS_CUDA
+#include "tbrs_cuda.h"
+#endif
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef TBRS_ITT
+#include <ittnotify.h>
+#endif
+#ifdef TBRS_SDT
+#include <sys/sdt.h>
+#endif
+
+// TRACE BUILD
+#ifndef TBRS_TRACE
+#define TBRS_TRACE 1                // 0 removes the verbose trace from the model
+#endif
+
+// PROFILE BUILD
+#ifndef TBRS_PROFILE
+#define TBRS_PROFILE 1              // 0 removes the counters and timers of profile 1
+#endif
+
+// MODEL VARIANT
+#ifndef TBRS_CLASSIC
+#define TBRS_CLASSIC 0              // 1 gives the defaults of the classic TBRS* model (see reproduce_tbrs_code.c)
+#endif
+#if TBRS_CLASSIC
+#define defaultPositions 16
+#define defaultDistractors 30
+#define defaultItemUnits 64         // number of item units when they are not given by the embedding file
+#define defaultDistractorWeight .2  // proportion of encoding rate for distractors compared to items
+#define defaultItems classic
+#define defaultInterference classic
+#else
+#define defaultPositions 100
+#define defaultDistractors 90
+#define defaultItemUnits 100
+#define defaultDistractorWeight .5
+#define defaultItems embeddings
+#define defaultInterference overlap
+#endif
+#define defaultText(value) stringOf(value)  // default value in the help
+#define stringOf(value) #value
 
 //CONSTANTS
 #define nbUnitBlocks 9              // number of unit blocks in the position layer
 #define sizeOfPositionBlocks 6      // size of unit blocks in the position layer
-#define maxPosition 100              // maximum number of position
-#define maxMemoranda 10             // number of items
-#define maxDistractors 90           // number of distractors
-#define maxItem maxMemoranda+maxDistractors
-#define nbItemUnits 100             // number of units in the item layer -- for some reason this is 1 non- -1 for every 4
-// 129 stops without segmentation fault, 108-128 is fault.
-// below runs fine, above stops
-// also the total is actually this number -1
-#define distractorEncodingWeight .5 // proportion of encoding rate for distractors compared to items - .5
+#define nbPositionUnits (nbUnitBlocks*sizeOfPositionBlocks)  // number of units in the position layer
+#define arenaAlignment 64           // alignment of the matrices of a context (cache line)
+#define rowAlignment (arenaAlignment/sizeof(float))  // rows of the matrices are padded to a multiple of this number of floats
+#define paddedSize(n) (((n)+rowAlignment-1)/rowAlignment*rowAlignment)
+#define positionStride paddedSize(nbPositionUnits)  // size of the rows of itemPositionMatrix
 #define maxDisplayedUnits nbItemUnits
 
 // COLORS
@@ -51,53 +294,276 @@
 #define RESET "\x1B[0m"
 
 // PARAMETERS 
-float param_P=.3;              // Proportion of units maintained from each position to the next
-float param_R=6;               // Mean memory processing rate, governing mean speed of encoding, refreshing, recall
-float param_s=1;               // Standard deviation of processing rates
-float param_tauE=.95;          // Criterion for encoding strength
-float param_L=(float)1/9;      // Asymptot
-float param_theta=.05;         // Retrieval threshold
-float param_sigma=.02;         // Standard deviation of Gaussian noise added to item activations at retrieval
-float param_D=.5;              // Decay rate
-float param_Tr=.08;            // Mean time taken to refresh an item
-float param_tauOp=.95;         // Response criterion for processing
-float param_Ta=.5;             // Mean duration of attentional capture by processing steps
-float param_freeTime=1;        // Free time following each processing step - 1
-int param_freeTimeIncludesOpDuration=1; // free time can include or not the operation duration 
-int param_refreshLastStopped=0;  // refreshing can start on the first letter (no) or on the last one when stopped (yes)  
-int param_attentionalFocusSize=1; // size of the attentional focus
-int nbmemo=7;                  // 7 items to memorize
-float param_memoDistr=1;       // number of domain 1 items for each domain 2 item (1 means 50-50, 3 means 75-25...)
-int nbop=4;                    // 4 processing operations between each item
-float presentationTime=1.5;    // presentation time = 1.5s
-int param_deterministic=0;     // non-deterministic behavior (seed is set to time)
-float param_itemDistractorOverlap=0.4;
-float param_itemDistractorNoise=1;
-float param_itemItemOverlap=0.4;
-int param_sameDist=0;          // Distractors are different from each other
-
-// MODEL VARIABLES
-float var_te;
-float var_tr;
-float var_eta;
-float var_r;
-float var_tauR;
-float var_Rop;
-float var_rop;
-float var_ta;
+// Parameters of the model. The command line sets param, each context has a copy of the parameters
+// of the point it is simulating (see SWEEP)
+typedef struct {
+  float P;                     // Proportion of units maintained from each position to the next
+  float R;                     // Mean memory processing rate, governing mean speed of encoding, refreshing, recall
+  float s;                     // Standard deviation of processing rates
+  float tauE;                  // Criterion for encoding strength
+  float L;                     // Asymptot
+  float theta;                 // Retrieval threshold
+  float sigma;                 // Standard deviation of Gaussian noise added to item activations at retrieval
+  float D;                     // Decay rate
+  float Tr;                    // Mean time taken to refresh an item
+  float tauOp;                 // Response criterion for processing
+  float Ta;                    // Mean duration of attentional capture by processing steps
+  float freeTime;              // Free time following each processing step - 1
+  int freeTimeIncludesOpDuration; // free time can include or not the operation duration 
+  int refreshLastStopped;      // refreshing can start on the first letter (no) or on the last one when stopped (yes)  
+  int attentionalFocusSize;    // size of the attentional focus
+  int nbmemo;                  // number of items to memorize
+  float memoDistr;             // number of domain 1 items for each domain 2 item (1 means 50-50, 3 means 75-25...)
+  int nbop;                    // number of processing operations between each item
+  float presentationTime;      // presentation time
+  float itemDistractorOverlap;
+  float itemDistractorNoise;
+  float itemItemOverlap;
+  int sameDist;                // Distractors are different from each other (0) or identical (1)
+  float distractorWeight;      // proportion of encoding rate for distractors compared to items
+  // MODEL VARIABLES, computed from the parameters above by prepareParameters()
+  float logTauE;
+  float tauR;
+  float Rop;
+  double logTauR;              // -log(1-tauR): refreshing duration times the rate
+  double logTauOp;             // -log(1-tauOp): processing duration times the rate
+  float noiseScale;            // scale of the retrieval noise
+} modelParameters;
+modelParameters param={
+  .P=.3,
+  .R=6,
+  .s=1,
+  .tauE=.95,
+  .L=(float)1/9,
+  .theta=.05,
+  .sigma=.02,
+  .D=.5,
+  .Tr=.08,
+  .tauOp=.95,
+  .Ta=.5,
+  .freeTime=1,
+  .freeTimeIncludesOpDuration=1,
+  .refreshLastStopped=0,
+  .attentionalFocusSize=1,
+  .nbmemo=7,                   // 7 items to memorize
+  .memoDistr=1,
+  .nbop=4,                     // 4 processing operations between each item
+  .presentationTime=1.5,       // presentation time = 1.5s
+  .itemDistractorOverlap=0.4,
+  .itemDistractorNoise=1,
+  .itemItemOverlap=0.4,
+  .sameDist=0,
+  .distractorWeight=defaultDistractorWeight
+};
+
+// SIMULATION PARAMETERS
+long param_deterministic=0;    // seed of the random streams (0 means non-deterministic behavior, seed is set to time)
+int param_nbThreads=1;         // number of worker threads running the replications
+int param_nearest=0;           // method used to find the closest LTM item (see NEAREST LTM ITEM)
+int param_prefixDims=16;       // number of dimensions compared to build the shortlist of the prefix method
+int param_shortlist=8;         // number of items of the shortlist of the prefix method
+int param_batch=1;             // number of replications run in lockstep by a worker
+#define deviceCPU 0
+#define deviceCUDA 1
+int param_device=deviceCPU;    // engine running the replications (device cpu|cuda)
+int *param_design=NULL;        // operations after each item, cycled over the list (design n1,n2,...), NULL for nbop
+int param_designLength=0;
+int param_fastMath=0;          // polynomial exponential instead of exp() (see FAST MATH)
+int param_interference=TBRS_CLASSIC ? 3 : 0;  // interference model, classic or overlap (see INTERFERENCE MODELS)
+float param_interferenceWeight=.4;  // interference of a new memorandum with the WM items (interference memoranda)
+#define processingNormal 0
+#define processingAutopilot 1       // the distractor is encoded at all the positions of the list
+int param_processing=processingNormal;
+int param_profile=0;           // count and time the phases of the trials (see PROFILE)
+#define precisionFP32 0
+#define precisionBF16 1
+#define precisionFP16 2
+#define precisionInt8 3
+int param_precision=precisionFP32; // storage of the LTM representations read by the closest LTM item search (see NEAREST LTM ITEM)
+
+// DIMENSIONS
+int maxPosition=defaultPositions;      // maximum number of position
+int maxMemoranda=10;           // number of items
+int maxDistractors=defaultDistractors; // number of distractors
+int maxItem;                   // maxMemoranda+maxDistractors
+int nbItemUnits=0;             // number of units in the item layer (0 = from the embedding file)
+int itemStride;                // size of the rows of the item matrices (nbItemUnits padded)
 
 // IMPLEMENTATION VARIABLES
+#if TBRS_TRACE
 int VERBOSE=0;
-int PRESET=1;
+#else
+#define VERBOSE 0                   // trace code is removed by the compiler
+#endif
+#define itemsRandom 0                 // memoranda: random patterns on all the units
+#define itemsEmbeddings 1             // rows of the embedding file
+#define itemsClassic 2                // random patterns on the first quarter of the units (TBRS*)
+int PRESET=TBRS_CLASSIC ? itemsClassic : itemsEmbeddings;
 int QUIET=0;
-float logTauE;
-float globalTime;
-int nbPositionUnits;
-int lastItem;
-int distractorNumber;
+#define resultFormatText 0          // "#   n: Recalled = ..." lines on stderr
+#define resultFormatCSV 1
+#define resultFormatBinary 2
+int resultFormat=resultFormatText;
+char *resultsPrefix=NULL;           // results <prefix>
+FILE *trialsFile=NULL;              // recalls of the replications (stderr in text format)
+FILE *pointsFile=NULL;              // results of the points
+char *eventsFileName=NULL;          // events <file>
+FILE *eventsFile=NULL;              // events of the sampled trials
+int param_eventSampling=1;          // one trial out of param_eventSampling is traced (sample <N>)
+int nbPointsWritten=0;              // points already written in the results
+
+// RANDOM STREAM
+#define normalBufferSize 64         // number of Gaussian numbers generated at once
+typedef struct {
+  uint64_t s[4];                    // state of the xoshiro256** generator
+} rngState;
+
+// RESULT WRITER
+#define resultBufferSize (1<<20)   // bytes kept in memory before being written to the spill file
+typedef struct {
+  char *buffer;                     // last records written
+  size_t used;
+  FILE *spill;                      // temporary file holding the previous records (NULL if none)
+  long spilled;                     // bytes in the spill file
+} resultWriter;
+
+// EVENT TRACE
+#define eventRingSize 4096          // events kept for a trial (power of 2): the oldest ones are overwritten
+#define eventEncode 1               // item encoded at position (value = encoding duration)
+#define eventRefresh 2              // item reencoded at position from WM item other (value = duration)
+#define eventDistractor 3           // distractor item alters WM item other retrieved at position (other 0 = autopilot, only associated with position, value = encoding strength)
+#define eventRetrieval 4            // LTM item retrieved at position from WM item other (item 0 below theta, value = activation max)
+#define eventDecay 5                // all the items but item decay (-1 = none, value = factor)
+#define eventProcessing 6           // processing of distractor item (value = duration)
+#define eventRecall 7               // item recalled at position (0 = none, value = activation max)
+typedef struct {
+  float time;                       // globalTime at the end of the event (from the start of the trial)
+  float value;
+  uint8_t type;
+  uint8_t unused;
+  int16_t position;
+  int16_t item;
+  int16_t other;
+} traceEvent;
 
-// EMBEDDINGS LIST
-float embeddingsList [maxMemoranda][nbItemUnits];
+// REFRESH STATE
+typedef struct {
+  float timeAvailable;              // time left for the next groups
+  int currentPosition;              // first position of the next group
+  int cpi;                          // next position of the current group
+  int afsi;                         // items of the current group left to refresh (0 = no current group)
+  float reencodingDuration;         // duration of the reencodings of the current group (-1 = not known yet)
+} refreshState;
+
+// CLOSEST LTM ITEM OF A WM ITEM (see REFRESH CACHES)
+typedef struct {
+  uint64_t stamp;                   // clock of the context when the search was made
+  int nbItems;                      // LTM items compared (1..nbItems)
+  int item;
+  float distance;
+} nearestEntry;
+
+// PROFILE COUNTS (see PROFILE)
+#define profileEncode 0               // timed phases
+#define profileRefresh 1
+#define profileProcessing 2
+#define profileRecall 3
+#define profileRetrieve 4
+#define profileDecay 5
+#define profileInterfere 6
+#define profileNearest 7
+#define nbProfilePhases 8
+#define profileFailedRetrievals 0     // counted events: activation below theta
+#define profileDistractorPatterns 1   // distractor patterns created
+#define profileNearestLookups 2       // lookups of the closest LTM item cache
+#define nbProfileCounters 3
+typedef struct {
+  uint64_t trials;
+  uint64_t calls[nbProfilePhases];
+  uint64_t ticks[nbProfilePhases];
+  uint64_t counters[nbProfileCounters];
+} profileCounts;
+#define profileWords (sizeof(profileCounts)/sizeof(uint64_t))
+
+// TRIAL CONTEXT
+// Everything a replication modifies. Each worker thread owns one, so that replications can run in parallel
+// The matrices have runtime dimensions. They are pointers into the arena of the context and are
+// used through pointers to arrays, e.g. float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+// Rows are indexed by item (0 = no item), units from 0. Each row starts on a cache line and its
+// padding units are 0. Only the rows of the active items (1..nbActiveItems) are valid in a trial
+typedef struct trialContext {
+  modelParameters param;                              // parameters of the point being simulated
+  void *arena;                                        // one aligned block holding all the matrices below
+  float *itemPositionMatrix;                          // [maxItem+1][positionStride]
+  float *itemStrength;                                // [maxItem+1] WM representations of item strengths
+  int *positionCodes;                                 // [maxPosition+1][nbUnitBlocks] active position unit of each block
+  float *itemVectorsInWM;                             // [maxItem+1][itemStride] WM representations of items
+  float *itemVectorsInLTM;                            // [maxItem+1][itemStride] LTM representations of items
+  float *retrievalNoise;                              // [maxItem+1] noise added to the activations of a retrieval
+  float *ltmNorms;                                    // [maxItem+1] squared norms of the LTM representations
+  void *ltmCodes;                                     // [maxItem+1][itemStride] LTM representations at the storage precision (NULL in fp32)
+  float *ltmScales;                                   // [maxItem+1] scale of the int8 codes of each item
+  float *decodedRow;                                  // [itemStride] LTM representation decoded from its codes
+  double *rowLevels;                                  // [maxItem+1] decay level at which each row of itemPositionMatrix is up to date
+  float *activationScales;                            // [maxItem+1] pending decay of the rows, at retrieval
+  float *traceActivations;                            // [maxItem+1] activations displayed by the trace (NULL if no trace)
+  float *unknownPattern;                              // [itemStride] LTM representation of a new item, not characterized along any dimension
+  float unknownNorm;                                  // its squared norm
+  float *patternScratch;                              // [itemStride] distractor pattern being created
+  uint64_t cacheClock;                                // last version given to a change (see REFRESH CACHES)
+  uint64_t *rowVersions;                              // [maxItem+1] version of each row of itemPositionMatrix
+  uint64_t *wmVersions;                               // [maxItem+1] version of each WM representation
+  uint64_t *ltmVersions;                              // [maxItem+1] version of each LTM representation
+  float *activationCache;                             // [maxPosition+1][maxItem+1] activations of the items at each position, before decay
+  uint64_t *activationStamps;                         // [maxPosition+1][maxItem+1] version of the row each cached activation was summed from
+  nearestEntry *nearestCache;                         // [maxItem+1] closest LTM item of each WM item
+  double decayLevel;                                  // product of all the decay factors of the trial
+  int nbActiveItems;                                  // memoranda and distractors created so far in the trial
+  float globalTime;
+  int lastItem;
+  int distractorNumber;
+  float var_te;
+  float var_tr;
+  float var_eta;
+  float var_rop;
+  float var_ta;
+  rngState rng;                                       // random stream of the current replication
+  rngState seedStream;                                // seed stream of replication seedReplication (see seekSeedStream)
+  int seedReplication;                                // 0 if seedStream is not set
+  uint64_t seedOfStream;
+  float normalBuffer[normalBufferSize];               // Gaussian numbers not used yet
+  int normalIndex;                                    // next Gaussian number to use in normalBuffer
+  long nbCorrect;                                     // results accumulated over the replications of the context
+  int pointNumber;                                    // number of the point being simulated (in the results)
+  resultWriter results;                               // recalls of the replications run by the context
+  int recording;                                      // the events of the current trial are traced
+  long nbEvents;                                      // events of the current trial (ring index)
+  traceEvent *events;                                 // [eventRingSize] (NULL if no event file)
+  resultWriter eventLog;                              // events of the traced replications
+  refreshState refreshing;                            // refresh in progress
+  profileCounts profile;                              // counts of the current job (profile 1)
+  int nbLanes;                                        // trials run in lockstep (batch <value>)
+  struct trialContext *lanes;                         // [nbLanes] contexts of the trials of a batch (the context itself if nbLanes=1)
+  void *lanesArena;                                   // block holding the matrices of the lanes
+  long *serialPositionCount;                          // [maxPosition+1]
+} __attribute__((aligned(arenaAlignment))) trialContext;   // contexts of different threads do not share cache lines
+
+// EMBEDDING STORE
+typedef struct {
+  int rows;                // number of embeddings
+  int cols;                // number of dimensions of each embedding
+  const float *data;       // rows x cols values, row after row
+  void *mapping;           // memory mapped file, NULL if the values were parsed from text
+  size_t mappingSize;
+  float *values;           // values owned by the store (text file, or byte-swapped binary file)
+  const char **words;      // [rows] word of each row (in the mapping), NULL if the file has no vocabulary
+} embeddingStore;
+embeddingStore embeddings;
+char *embeddingsFileName="pca_embeddings_c.txt";
+char *memorandaWords=NULL;     // words <list>: words of the memoranda
+int param_drawMemoranda=0;     // draw <0 or 1>: memoranda drawn in the pool for each trial
+int *memorandaPool=NULL;       // rows of the embeddings the memoranda are taken from
+int memorandaPoolSize=0;
 
 /*********/
 /* ERROR */
@@ -153,11 +619,110 @@ char name(int code) {
 /************/
 /*  RANDOM  */
 /************/
-float randomNormal(float mean, float std) {
-  // Return a random number from a normal distribution using the Box-Muller method
-  float u=rand()/((double)RAND_MAX + 1);
-  float v=rand()/((double)RAND_MAX + 1);
-  return(mean+std*sqrt(-2*log(u))*cos(2*3.1415926535*v));
+// All random numbers of the model are drawn from the functions below, which only rely on
+// rngNext(). Another generator can be plugged in by changing rngState, rngSeed, rngNext and rngJump.
+
+uint64_t rngNext(rngState *rng) {
+  // Return the next 64 random bits of the stream (xoshiro256**, Blackman & Vigna 2018)
+  uint64_t *s=rng->s;
+  uint64_t result=s[1]*5;
+  result=((result<<7) | (result>>57))*9;
+  uint64_t t=s[1]<<17;
+  s[2]^=s[0];
+  s[3]^=s[1];
+  s[1]^=s[2];
+  s[0]^=s[3];
+  s[2]^=t;
+  s[3]=(s[3]<<45) | (s[3]>>19);
+  return(result);
+}
+
+void rngSeed(rngState *rng, uint64_t seed) {
+  // Initialize the stream from a seed, using splitmix64 to fill the state
+  int i;
+  for(i=0;i<4;i++) {
+    uint64_t z=(seed+=0x9E3779B97F4A7C15ULL);
+    z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+    z=(z^(z>>27))*0x94D049BB133111EBULL;
+    rng->s[i]=z^(z>>31);
+  }
+}
+
+void rngJump(rngState *rng) {
+  // Advance the stream by 2^128 numbers. Successive jumps give non-overlapping streams
+  static const uint64_t jump[]={0x180ec6d33cfd0abaULL,0xd5a61266f0c9392cULL,0xa9582618e03fc9aaULL,0x39abdc4529b1661cULL};
+  uint64_t s[4]={0,0,0,0};
+  int i,b;
+  for(i=0;i<4;i++)
+    for(b=0;b<64;b++) {
+      if (jump[i] & ((uint64_t)1<<b)) {
+	s[0]^=rng->s[0];
+	s[1]^=rng->s[1];
+	s[2]^=rng->s[2];
+	s[3]^=rng->s[3];
+      }
+      rngNext(rng);
+    }
+  memcpy(rng->s,s,sizeof(s));
+}
+
+void startRandomStream(trialContext *ctx, rngState *stream) {
+  // Use the given stream for the next replication, with no Gaussian numbers left from the previous one
+  ctx->rng=*stream;
+  ctx->normalIndex=normalBufferSize;
+}
+
+float randomUniform(trialContext *ctx) {
+  // Return a random number in [0,1) with 24 random bits
+  return((rngNext(&ctx->rng)>>40)*(1.0f/16777216));
+}
+
+int randomBelow(trialContext *ctx, int n) {
+  // Return a random integer between 0 and n-1 (multiply-shift, no division)
+  return((int)(((rngNext(&ctx->rng)>>32)*(uint64_t)n)>>32));
+}
+
+void fillNormalBuffer(trialContext *ctx) {
+  // Generate normalBufferSize numbers from the standard normal distribution at once, using both
+  // outputs of the Box-Muller method. The transcendental loop has no dependency between
+  // iterations and can be vectorized by the compiler
+  float u[normalBufferSize/2],v[normalBufferSize/2];
+  int i;
+  for(i=0;i<normalBufferSize/2;i++) {
+    uint64_t bits=rngNext(&ctx->rng);
+    u[i]=((bits>>40)+1)*(1.0f/16777216);       // in (0,1] so that log(u) is finite
+    v[i]=(bits & 0xFFFFFF)*(1.0f/16777216);
+  }
+  for(i=0;i<normalBufferSize/2;i++) {
+    float radius=sqrtf(-2*logf(u[i]));
+    float angle=2*3.1415926535f*v[i];
+    ctx->normalBuffer[2*i]=radius*cosf(angle);
+    ctx->normalBuffer[2*i+1]=radius*sinf(angle);
+  }
+  ctx->normalIndex=0;
+}
+
+float randomNormal(trialContext *ctx, float mean, float std) {
+  // Return a random number from a normal distribution
+  if (ctx->normalIndex==normalBufferSize)
+    fillNormalBuffer(ctx);
+  return(mean+std*ctx->normalBuffer[ctx->normalIndex++]);
+}
+
+void randomNormals(trialContext *ctx, float values[], int nb) {
+  // Fill values[0..nb-1] with numbers from the standard normal distribution.
+  // They are the same numbers as nb successive calls to randomNormal(ctx,0,1)
+  int done=0;
+  while (done<nb) {
+    if (ctx->normalIndex==normalBufferSize)
+      fillNormalBuffer(ctx);
+    int nbCopied=normalBufferSize-ctx->normalIndex;
+    if (nbCopied>nb-done)
+      nbCopied=nb-done;
+    memcpy(values+done,ctx->normalBuffer+ctx->normalIndex,nbCopied*sizeof(float));
+    ctx->normalIndex+=nbCopied;
+    done+=nbCopied;
+  }
 }
 
 /*******/
@@ -181,16 +746,219 @@ int max(int val1,int val2) {
 }
 
 
+/*************/
+/* FAST MATH */
+/*************/
+// The decay factors and the encoding strengths are exponentials of durations times rates. With
+// fastMath, they are computed as 2^n*exp(r), n integer and |r|<=ln(2)/2, exp(r) by its Taylor
+// polynomial of degree 7 (truncation below 1e-9): the relative error is a few float roundings,
+// below fastExpBound. The code has no branch and vectorizes in loops
+#define fastExpBound 1e-6
+#define fastExpCheckPoints 100000   // points of [-fastExpCheckRange,0] compared with exp() by the benchmark
+#define fastExpCheckRange 20
+
+float fastExp(float x) {
+  union {float f; int32_t i;} scale;
+  float n,r,p;
+  x=x<-87 ? -87 : x>88 ? 88 : x;             // 2^n stays a normal float
+  n=rintf(x*1.44269504f);
+  r=x-n*.693145752f-n*1.42860677e-6f;       // ln(2) in two parts, the first one exact for small n
+  p=1+r*(1+r*(1.f/2+r*(1.f/6+r*(1.f/24+r*(1.f/120+r*(1.f/720+r*(1.f/5040)))))));
+  scale.i=((int32_t)n+127)<<23;
+  return(p*scale.f);
+}
+
+double modelExp(float x) {
+  // Exponential of the model (same value as exp(x) unless fastMath is set)
+  if (param_fastMath)
+    return(fastExp(x));
+  return(exp(x));
+}
+
+double fastExpError() {
+  // Largest relative error of fastExp() on the durations times rates of the model
+  double error=0,x,reference;
+  int i;
+  for(i=0;i<=fastExpCheckPoints;i++) {
+    x=(float)(-fastExpCheckRange*(double)i/fastExpCheckPoints);
+    reference=exp(x);
+    if (fabs(fastExp(x)-reference)/reference>error)
+      error=fabs(fastExp(x)-reference)/reference;
+  }
+  return(error);
+}
+
+
+/*******************/
+/* EMBEDDING STORE */
+/*******************/
+// Embeddings are read in one of two formats:
+//  - the text export of the notebook (to_c_array): comma separated values, row after row, ending with ';'.
+//    The file has no header, so rows and cols are the ones requested by the model.
+//  - the binary export of the notebook (to_c_binary), which is memory mapped:
+//       "TBRSEMB1" (8 bytes), rows, cols, dtype (0 = float32), vocabulary size (little-endian uint32)
+//       followed by rows x cols little-endian float32, row after row, then by the vocabulary if its
+//       size is not 0: the word of each row, in the order of the rows, each ending with a '\0'
+#define embeddingMagic "TBRSEMB1"
+#define embeddingHeaderSize 24
+
+uint32_t readUint32LE(const unsigned char *bytes) {
+  return((uint32_t)bytes[0] | (uint32_t)bytes[1]<<8 | (uint32_t)bytes[2]<<16 | (uint32_t)bytes[3]<<24);
+}
+
+void loadVocabulary(embeddingStore *store, char *fileName, const char *vocabulary, size_t size) {
+  // Point to the word of each row in the vocabulary of the mapping
+  size_t offset=0;
+  int row;
+  if ((store->words=malloc(sizeof(char *)*(store->rows+1)))==NULL)
+    error("Cannot allocate the vocabulary of file:",fileName);
+  for(row=0;row<store->rows;row++) {
+    const char *end=memchr(vocabulary+offset,0,size-offset);
+    if (end==NULL)
+      error("The vocabulary has fewer words than rows in embedding file:",fileName);
+    store->words[row]=vocabulary+offset;
+    offset=end-vocabulary+1;
+  }
+}
+
+void loadBinaryEmbeddings(embeddingStore *store, char *fileName, int fd) {
+  // Map a binary embedding file. Values are used in place when the host is little-endian
+  struct stat st;
+  const unsigned char *bytes;
+  uint32_t one=1;
+  size_t i,nbValues;
+
+  if (fstat(fd,&st) || st.st_size<embeddingHeaderSize)
+    error("Truncated embedding file:",fileName);
+  store->mappingSize=st.st_size;
+  store->mapping=mmap(NULL,store->mappingSize,PROT_READ,MAP_PRIVATE,fd,0);
+  if (store->mapping==MAP_FAILED)
+    error("Cannot map embedding file:",fileName);
+  bytes=store->mapping;
+  store->rows=readUint32LE(bytes+8);
+  store->cols=readUint32LE(bytes+12);
+  if (readUint32LE(bytes+16)!=0)
+    error("Unsupported value type (only float32) in embedding file:",fileName);
+  nbValues=(size_t)store->rows*store->cols;
+  if (store->mappingSize<embeddingHeaderSize+4*nbValues+readUint32LE(bytes+20))
+    error("Truncated embedding file:",fileName);
+  if (readUint32LE(bytes+20))
+    loadVocabulary(store,fileName,(const char *)bytes+embeddingHeaderSize+4*nbValues,readUint32LE(bytes+20));
+  if (*(unsigned char *)&one)  // little-endian host
+    store->data=(const float *)(bytes+embeddingHeaderSize);
+  else {
+    store->values=malloc(nbValues*sizeof(float));
+    if (store->values==NULL)
+      error("Cannot allocate embeddings of file:",fileName);
+    for(i=0;i<nbValues;i++) {
+      uint32_t v=readUint32LE(bytes+embeddingHeaderSize+4*i);
+      memcpy(&store->values[i],&v,sizeof(float));
+    }
+    store->data=store->values;
+  }
+}
+
+void loadTextEmbeddings(embeddingStore *store, char *fileName, int rows, int cols) {
+  // Parse rows x cols comma separated values
+  FILE *fp=fopen(fileName,"r");
+  size_t i;
+  if (fp==NULL)
+    error("Error opening file",fileName);
+  store->rows=rows;
+  store->cols=cols;
+  store->values=malloc((size_t)rows*cols*sizeof(float));
+  if (store->values==NULL)
+    error("Cannot allocate embeddings of file:",fileName);
+  for(i=0;i<(size_t)rows*cols;i++)
+    if (fscanf(fp,"%f,",&store->values[i])!=1)
+      error("Not enough values in embedding file:",fileName);
+  fclose(fp);
+  store->data=store->values;
+}
+
+void loadEmbeddings(embeddingStore *store, char *fileName, int rows, int cols) {
+  // Load at least rows embeddings of at least cols dimensions from a text or binary file
+  // cols=0 means all the dimensions of a binary file, defaultItemUnits for a text file
+  char magic[8];
+  int fd=open(fileName,O_RDONLY);
+  if (fd<0)
+    error("Error opening file",fileName);
+  memset(store,0,sizeof(*store));
+  if (read(fd,magic,8)==8 && !memcmp(magic,embeddingMagic,8))
+    loadBinaryEmbeddings(store,fileName,fd);
+  else
+    loadTextEmbeddings(store,fileName,rows,cols ? cols : defaultItemUnits);
+  close(fd);
+  if (store->rows<rows || store->cols<cols)
+    error("Embedding file has too few rows or dimensions:",fileName);
+}
+
+void unloadEmbeddings(embeddingStore *store) {
+  if (store->mapping)
+    munmap(store->mapping,store->mappingSize);
+  free(store->values);
+  free(store->words);
+  memset(store,0,sizeof(*store));
+}
+
+const float *embeddingRow(embeddingStore *store, int row) {
+  // Return the embedding number row (from 0)
+  return(store->data+(size_t)row*store->cols);
+}
+
+int embeddingWordRow(embeddingStore *store, const char *word) {
+  // Return the row of a word, or -1 if it is not in the vocabulary
+  int row;
+  for(row=0;store->words && row<store->rows;row++)
+    if (!strcmp(store->words[row],word))
+      return(row);
+  return(-1);
+}
+
+void createMemorandaPool(embeddingStore *store) {
+  // Rows the memoranda are taken from: the rows of the words of the list, or else all the rows
+  // if they are drawn, the first ones otherwise
+  int i;
+  if (memorandaWords) {
+    char copy[strlen(memorandaWords)+1];
+    char *word;
+    if (store->words==NULL)
+      error("words needs an embedding file with a vocabulary:",embeddingsFileName);
+    memorandaPool=malloc(sizeof(int)*(strlen(memorandaWords)/2+1));
+    if (memorandaPool==NULL)
+      error("Cannot allocate the memoranda.","");
+    for(word=strtok(strcpy(copy,memorandaWords),",");word!=NULL;word=strtok(NULL,",")) {
+      if ((memorandaPool[memorandaPoolSize]=embeddingWordRow(store,word))<0)
+	error("Word not in the vocabulary of the embeddings:",word);
+      for(i=0;i<memorandaPoolSize;i++)
+	if (memorandaPool[i]==memorandaPool[memorandaPoolSize])
+	  error("Word given twice in the words of the memoranda:",word);
+      memorandaPoolSize++;
+    }
+  }
+  else {
+    memorandaPoolSize=param_drawMemoranda ? store->rows : maxMemoranda;
+    if ((memorandaPool=malloc(sizeof(int)*memorandaPoolSize))==NULL)
+      error("Cannot allocate the memoranda.","");
+    for(i=0;i<memorandaPoolSize;i++)
+      memorandaPool[i]=i;
+  }
+  if (memorandaPoolSize<maxMemoranda)
+    error("Fewer words than memoranda in:",memorandaWords);
+}
+
+
 /**************************** **********/
 /* DISPLAY ITEM POSITION ASSOCIATIONS */
 /**************************************/
-int displayItemPosAssociations(float itemPositionMatrix[][nbPositionUnits+1], int lastPosition) {
+int displayItemPosAssociations(trialContext *ctx, int lastPosition) {
   // Display the first item-position associations of a given position
+  float (*itemPositionMatrix)[positionStride]=(void *)ctx->itemPositionMatrix;
   int i,j;
   for(i=1;i<=lastPosition;i++) {
     printf("   %c: ",i+'A'-1);
-    for(j=1;j<=3*sizeOfPositionBlocks;j++)
-      printf(".%d/",(int)(1000*itemPositionMatrix[i][j])%1000);
+    for(j=0;j<3*sizeOfPositionBlocks;j++)
+      printf(".%d/",(int)(1000*itemPositionMatrix[i][j]*(float)(ctx->decayLevel/ctx->rowLevels[i]))%1000);  // with the pending decay
     printf("...\n");
   }
 }
@@ -199,11 +967,11 @@ int displayItemPosAssociations(float itemPositionMatrix[][nbPositionUnits+1], in
 /**********************/
 /* DISPLAY ITEM UNITS */
 /**********************/
-int displayItemUnits(float itemVectorsInWM[][nbItemUnits+1],int item) {
+int displayItemUnits(float itemVectorsInWM[][itemStride],int item) {
   // Display item units - mark
   int i;
   printf("   %c: ",name(item));
-  for(i=1;i<min(maxDisplayedUnits,nbItemUnits);i++)
+  for(i=0;i<min(maxDisplayedUnits,nbItemUnits);i++)
     pr2(itemVectorsInWM[item][i]);
   printf("\n");
 }
@@ -212,19 +980,19 @@ int displayItemUnits(float itemVectorsInWM[][nbItemUnits+1],int item) {
 /*************************/
 /* CREATE RANDOM PATTERN */    
 /*************************/
-void createRandomPattern(float pattern[],int min, int max) {
+void createRandomPattern(trialContext *ctx,float pattern[],int min, int max) {
   // Create a random pattern from index min to index max included
   int i;
   int nb=0;
   for(i=min;i<=max;i++)
-    pattern[i]=rand()/((double)RAND_MAX + 1);
+    pattern[i]=randomUniform(ctx);
 }
 
 
 /*********************************/
 /* CREATE SIMILAR RANDOM PATTERN */    
 /*********************************/
-void createSimilarRandomPattern(float pattern[],float refPattern[],float std, int min, int max) {
+void createSimilarRandomPattern(trialContext *ctx,float pattern[],float refPattern[],float std, int min, int max) {
   // Create a random pattern more or less similar to refPattern
   // Each unit has the value of the corresponding reference unit + a noise with standard deviation std,
   // from index min to index max included
@@ -233,9 +1001,9 @@ void createSimilarRandomPattern(float pattern[],float refPattern[],float std, in
   float val;
   for(i=min;i<=max;i++) {
     if (refPattern[i]==-1)
-      val=rand()/((double)RAND_MAX + 1);
+      val=randomUniform(ctx);
     else {
-      val=randomNormal(refPattern[i],std);
+      val=randomNormal(ctx,refPattern[i],std);
       if (val<0)
 	val=0;
       else if (val>1)
@@ -249,7 +1017,7 @@ void createSimilarRandomPattern(float pattern[],float refPattern[],float std, in
 /*********************************/
 /* CREATE OVERLAPING RANDOM PATTERN */    
 /*********************************/
-void createOverlapingRandomPattern(float pattern[],float refPattern[],int patternSize,float p) {
+void createOverlapingRandomPattern(trialContext *ctx,float pattern[],float refPattern[],int patternSize,int width,float p) {
   /*This is the method to change for interfering using other memoranda*/
   // Create a new pattern which shares p% units with the reference Pattern
   // The reference pattern is filled with random values and -1. For instance:
@@ -259,73 +1027,847 @@ void createOverlapingRandomPattern(float pattern[],float refPattern[],int patter
   //     -1-1-1-1-1-1-1-1-1-1 x x x x x  if p=0
   //     -1-1-1-1-1-1-1 x x x x x -1-1-1 if p=.6
   //     -1-1-1-1-1 x x x x x -1-1-1-1-1 if p=1
-  int i,c,alea,firstUsedUnit;
+  // The random values start at the first known unit of the reference pattern, shifted by (1-p)
+  // of the width units of the new pattern, and are then shuffled within the region
+  int i=0,c,alea,firstUsedUnit;
   float tmp;
   if (VERBOSE)
     printf("   Create a distractor sharing %d%% units with the item at previous position\n",(int)(p*100));
-  //  int nbCommonUnits=patternSize/2*p;
-  i=1;
-  while (i<=patternSize){// && refPattern[i]==-1) { // comment out refpattern part to avoid segfault if needed
-    pattern[i]=-1;
-    i++;
-  }
+  // All indexes are bounded by patternSize: the pattern is a row of a context matrix and writing
+  // past its end used to overwrite the next row (and beyond the last one, other context data)
+  while (i<patternSize && (int)refPattern[i]==-1)
+    pattern[i++]=-1;
   firstUsedUnit=i;
-  for(c=1;c<=(1-p)*patternSize;c++) // copy a proportion (1-p) -1s /4
+  for(c=1;c<=(1-p)*width && i<patternSize;c++) // copy a proportion (1-p) -1s
     pattern[i++]=-1;
-  createSimilarRandomPattern(pattern,refPattern,param_itemDistractorNoise,i,i+patternSize/4);
+  createSimilarRandomPattern(ctx,pattern,refPattern,ctx->param.itemDistractorNoise,i,min(i+width,patternSize-1));
   // shuffle the units within the region used by the reference pattern
-  for(c=firstUsedUnit+patternSize;c>firstUsedUnit;c--) { // /4
-    // alea is a random number between i and c
-    alea=rand()%(patternSize)+firstUsedUnit;// /4
+  for(c=min(firstUsedUnit+width,patternSize-1);c>firstUsedUnit;c--) {
+    // alea is a random number between firstUsedUnit and firstUsedUnit+width-1
+    alea=randomBelow(ctx,min(width,patternSize-firstUsedUnit))+firstUsedUnit;
     tmp=pattern[alea];
     pattern[alea]=pattern[c];
     pattern[c]=tmp;
   }
-  for(c=i+patternSize+1;c<=patternSize;c++)// /4
+  for(c=i+width+1;c<patternSize;c++)
     pattern[c]=-1;
 }
 
 
+/***********************/
+/* INTERFERENCE MODELS */
+/***********************/
+// A model gives the LTM representation of a distractor from the WM representation of the item
+// retrieved at its position, and tells whether the memoranda interfere with the WM items when
+// they are encoded (see INTERFERE). Models are chosen at runtime (interference <name>)
+#define interferenceOverlap 0
+#define interferenceSimilar 1
+#define interferenceMemoranda 2
+#define interferenceClassic 3
+typedef struct {
+  char *name;
+  void (*createPattern)(trialContext *ctx,float pattern[],float refPattern[]);
+  int memorandaInterfere;       // each new memorandum interferes with all the items in WM
+} interferenceModel;
+
+void overlapPattern(trialContext *ctx,float pattern[],float refPattern[]) {
+  // The distractor has as many units as the reference pattern has known units from its first one
+  int first=0,last;
+  while (first<nbItemUnits && (int)refPattern[first]==-1)
+    first++;
+  for(last=first;last<nbItemUnits && (int)refPattern[last]!=-1;last++)
+    ;
+  createOverlapingRandomPattern(ctx,pattern,refPattern,nbItemUnits,last-first,ctx->param.itemDistractorOverlap);
+}
+
+void similarPattern(trialContext *ctx,float pattern[],float refPattern[]) {
+  // The reference pattern with a noise of standard deviation itemDistractorNoise on all its units
+  if (VERBOSE)
+    printf("   Create a distractor similar to the item at previous position\n");
+  createSimilarRandomPattern(ctx,pattern,refPattern,ctx->param.itemDistractorNoise,0,nbItemUnits-1);
+}
+
+void classicPattern(trialContext *ctx,float pattern[],float refPattern[]) {
+  // createOverlapingRandomPattern of the classic TBRS* model: the distractor has as many units
+  // as a classic memorandum (a quarter of the units)
+  createOverlapingRandomPattern(ctx,pattern,refPattern,nbItemUnits,nbItemUnits/4,ctx->param.itemDistractorOverlap);
+}
+
+interferenceModel interferenceModels[]={{"overlap",overlapPattern,0},{"similar",similarPattern,0},{"memoranda",overlapPattern,1},{"classic",classicPattern,0}};
+#define nbInterferenceModels (int)(sizeof(interferenceModels)/sizeof(interferenceModel))
+
+
+/**********************/
+/* ACTIVATION KERNEL */
+/**********************/
+// Activation of an item at a position = sum of the associations of the item with the active
+// units of the position (one per block, in increasing order). The sums are cached by position
+// (see REFRESH CACHES). The sum is then multiplied by the pending decay of the row (see DECAY)
+// and the noise is added, for several items at once.
+
+float positionActivation(const int positionCode[], const float itemPositionRow[]) {
+  // Sparse dot product of a position code with the row of an item
+  int k;
+  float somme=0;
+  for(k=0;k<nbUnitBlocks;k++)
+    somme+=itemPositionRow[positionCode[k]];
+  return(somme);
+}
+
+int maxActivation(const float sums[], const float scales[], int nbItems, const float noise[], float noiseScale, float activations[], float *activationMax) {
+  // Compute the activations of items 1..nbItems at a position from their sums of associations,
+  // scaled by scales[item], add noise[item]*noiseScale and return the most activated item (the
+  // first one in case of ties). Activations are stored in activations[] if it is not NULL
+  int item=1,bestItem=-1;
+  float best=-99999;
+  float somme;
+#if defined(__AVX512F__) || defined(__AVX2__)
+  int l;
+#if defined(__AVX512F__)
+#define activationLanes 16
+  __m512 scale=_mm512_set1_ps(noiseScale);
+#else
+#define activationLanes 8
+  __m256 scale=_mm256_set1_ps(noiseScale);
+#endif
+  float lanes[activationLanes];
+  for(;item+activationLanes-1<=nbItems;item+=activationLanes) {
+#if defined(__AVX512F__)
+    __m512 acc=_mm512_mul_ps(_mm512_loadu_ps(sums+item),_mm512_loadu_ps(scales+item));
+    acc=_mm512_add_ps(acc,_mm512_mul_ps(_mm512_loadu_ps(noise+item),scale));
+    _mm512_storeu_ps(lanes,acc);
+#else
+    __m256 acc=_mm256_mul_ps(_mm256_loadu_ps(sums+item),_mm256_loadu_ps(scales+item));
+    acc=_mm256_add_ps(acc,_mm256_mul_ps(_mm256_loadu_ps(noise+item),scale));
+    _mm256_storeu_ps(lanes,acc);
+#endif
+    for(l=0;l<activationLanes;l++) {
+      if (activations)
+	activations[item+l]=lanes[l];
+      if (lanes[l] > best) {
+	best=lanes[l];
+	bestItem=item+l;
+      }
+    }
+  }
+#undef activationLanes
+#endif
+  for(;item<=nbItems;item++) {  // scalar fallback and remaining items
+    float weightedNoise=noise[item]*noiseScale;
+    somme=sums[item]*scales[item]+weightedNoise;
+    if (activations)
+      activations[item]=somme;
+    if (somme > best) {
+      best=somme;
+      bestItem=item;
+    }
+  }
+  *activationMax=best;
+  return(bestItem);
+}
+
+
+/***********/
+/* PROFILE */
+/***********/
+// The phases are timed by a scope variable: its cleanup adds the ticks since its creation to the
+// context when the function returns, whatever the return. The ticks are converted to seconds with
+// the rate measured between startProfile() and the display of the results (see printPointProfile)
+typedef struct {
+  trialContext *ctx;
+  int phase;
+  uint64_t start;
+} profileScope;
+uint64_t profileStartTicks;
+double profileStartTime;
+#ifdef TBRS_ITT
+__itt_domain *ittDomain;
+__itt_string_handle *ittPhases[nbProfilePhases];
+#endif
+const char *profilePhaseNames[nbProfilePhases]={"encode","refresh","processing","recall","retrieve","decay","interfere","nearest"};
+
+static inline uint64_t readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return(__rdtsc());
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return(ticks);
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return(t.tv_sec*1000000000ull+t.tv_nsec);
+#endif
+}
+
+static inline profileScope startPhase(trialContext *ctx,int phase) {
+  profileScope scope={ctx,phase,0};
+  if (__builtin_expect(param_profile,0)) {
+#ifdef TBRS_ITT
+    __itt_task_begin(ittDomain,__itt_null,__itt_null,ittPhases[phase]);
+#endif
+#ifdef TBRS_SDT
+    DTRACE_PROBE1(tbrs,phase_begin,phase);
+#endif
+    scope.start=readTicks();
+  }
+  return(scope);
+}
+
+static inline void endPhase(profileScope *scope) {
+  if (__builtin_expect(param_profile,0)) {
+    uint64_t ticks=readTicks()-scope->start;
+    scope->ctx->profile.ticks[scope->phase]+=ticks;
+    scope->ctx->profile.calls[scope->phase]++;
+#ifdef TBRS_SDT
+    DTRACE_PROBE2(tbrs,phase_end,scope->phase,ticks);
+#endif
+#ifdef TBRS_ITT
+    __itt_task_end(ittDomain);
+#endif
+  }
+}
+
+#if TBRS_PROFILE
+#define profilePhase(ctx,phase) profileScope phaseScope __attribute__((cleanup(endPhase)))=startPhase(ctx,phase)
+#define profileCount(ctx,counter) do { if (__builtin_expect(param_profile,0)) (ctx)->profile.counters[counter]++; } while (0)
+#else
+#define profilePhase(ctx,phase)
+#define profileCount(ctx,counter)
+#endif
+
+
 /********************/
-/* RMSE COMPUTATION */
+/* NEAREST LTM ITEM */
 /********************/
-float rmse(float v1[],float v2[],int size) {
-  // Compute the root mean square error between two vectors
+// Methods used to find the LTM item closest to a WM item
+#define nearestExact 0      // squared distances to all the LTM items, with early abandon
+#define nearestNorms 1      // squared distances from the norms of the LTM items and dot products
+#define nearestPrefix 2     // approximate: exact distances only for a shortlist built on the first dimensions
+#define abandonBlock 32     // number of dimensions summed between two early abandon tests
+
+#if defined(__AVX2__)
+float horizontalSum256(__m256 v) {
+  __m128 half=_mm_add_ps(_mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1));
+  half=_mm_add_ps(half,_mm_movehl_ps(half,half));
+  half=_mm_add_ss(half,_mm_movehdup_ps(half));
+  return(_mm_cvtss_f32(half));
+}
+#endif
+
+// KERNEL SPECIALIZATION. The kernels are inlined in the dispatchers below once for each common
+// size of the rows (64 units of TBRS*, 100 units padded to 112, 768 units of BERT), where their
+// loops have constant bounds, and once for any size. The operations are the same in all the copies
+#define kernel static inline __attribute__((always_inline))
+#define dispatchOnSize(size,call)				\
+  switch(size) {						\
+  case 64: { const int size=64; return(call); }		\
+  case 100: { const int size=100; return(call); }		\
+  case 112: { const int size=112; return(call); }		\
+  case 768: { const int size=768; return(call); }		\
+  default: return(call);					\
+  }
+
+kernel float squaredDistanceKernel(const float v1[], const float v2[], int size, float bound) {
+  int i=0,end;
+  float somme=0,diff;
+  while (i<size) {
+    end=min(i+abandonBlock,size);
+#if defined(__AVX512F__)
+    __m512 acc=_mm512_setzero_ps();
+    for(;i+16<=end;i+=16) {
+      __m512 d=_mm512_sub_ps(_mm512_load_ps(v1+i),_mm512_load_ps(v2+i));
+      acc=_mm512_fmadd_ps(d,d,acc);
+    }
+    somme+=_mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+    __m256 acc=_mm256_setzero_ps();
+    for(;i+8<=end;i+=8) {
+      __m256 d=_mm256_sub_ps(_mm256_load_ps(v1+i),_mm256_load_ps(v2+i));
+      acc=_mm256_add_ps(acc,_mm256_mul_ps(d,d));
+    }
+    somme+=horizontalSum256(acc);
+#elif defined(__ARM_NEON)
+    float32x4_t acc=vdupq_n_f32(0);
+    for(;i+4<=end;i+=4) {
+      float32x4_t d=vsubq_f32(vld1q_f32(v1+i),vld1q_f32(v2+i));
+      acc=vmlaq_f32(acc,d,d);
+    }
+    somme+=vaddvq_f32(acc);
+#endif
+    for(;i<end;i++) {  // scalar fallback and tail
+      diff=v1[i]-v2[i];
+      somme+=diff*diff;
+    }
+    if (somme>=bound)
+      break;
+  }
+  return(somme);
+}
+
+float squaredDistance(const float v1[], const float v2[], int size, float bound) {
+  // Squared euclidean distance between v1[0..size-1] and v2[0..size-1], two rows of the context
+  // matrices (aligned). The sum is abandoned as soon as it reaches bound: the partial sum is
+  // returned, the distance can only be larger
+  dispatchOnSize(size,squaredDistanceKernel(v1,v2,size,bound));
+}
+
+kernel float dotProductKernel(const float v1[], const float v2[], int size) {
+  int i=0;
+  float somme=0;
+#if defined(__AVX512F__)
+  __m512 acc=_mm512_setzero_ps();
+  for(;i+16<=size;i+=16)
+    acc=_mm512_fmadd_ps(_mm512_load_ps(v1+i),_mm512_load_ps(v2+i),acc);
+  somme=_mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+  __m256 acc=_mm256_setzero_ps();
+  for(;i+8<=size;i+=8)
+    acc=_mm256_add_ps(acc,_mm256_mul_ps(_mm256_load_ps(v1+i),_mm256_load_ps(v2+i)));
+  somme=horizontalSum256(acc);
+#elif defined(__ARM_NEON)
+  float32x4_t acc=vdupq_n_f32(0);
+  for(;i+4<=size;i+=4)
+    acc=vmlaq_f32(acc,vld1q_f32(v1+i),vld1q_f32(v2+i));
+  somme=vaddvq_f32(acc);
+#endif
+  for(;i<size;i++)
+    somme+=v1[i]*v2[i];
+  return(somme);
+}
+
+float dotProduct(const float v1[], const float v2[], int size) {
+  // Dot product of v1[0..size-1] and v2[0..size-1], two rows of the context matrices (aligned)
+  dispatchOnSize(size,dotProductKernel(v1,v2,size));
+}
+
+// STORAGE PRECISION. With bf16, fp16 or int8, the search reads the LTM representations from
+// codes (ltmCodes) rather than from itemVectorsInLTM. bf16 keeps the 16 high bits of a float,
+// fp16 is IEEE half precision, int8 codes are multiples of a scale per item (the largest unit
+// is 127 times the scale). Both are rounded to nearest even. Padding units are coded 0
+size_t codeSize() {
+  // Bytes of a unit in ltmCodes
+  return(param_precision==precisionInt8 ? 1 : 2);
+}
+
+uint16_t floatToBF16(float value) {
+  union {float f; uint32_t u;} v={value};
+  return((v.u+0x7FFF+((v.u>>16) & 1))>>16);
+}
+
+float bf16ToFloat(uint16_t code) {
+  union {float f; uint32_t u;} v={.u=(uint32_t)code<<16};
+  return(v.f);
+}
+
+uint16_t floatToFP16(float value) {
+  // Overflows give infinities, small values subnormals or 0
+  union {float f; uint32_t u;} v={value};
+  uint32_t sign=(v.u>>16) & 0x8000,mantissa=v.u & 0x7FFFFF,half,rest,halfway;
+  int exponent=(int)((v.u>>23) & 0xFF)-127+15,shift;
+  if (exponent==0xFF-127+15)  // infinity or NaN
+    return(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+  if (exponent>=31)
+    return(sign | 0x7C00);
+  if (exponent<=0) {
+    if (exponent<-10)
+      return(sign);
+    shift=14-exponent;
+    mantissa|=0x800000;
+  }
+  else {
+    shift=13;
+    mantissa|=(uint32_t)exponent<<23;  // a carry of the rounding goes to the exponent
+  }
+  half=mantissa>>shift;
+  rest=mantissa & ((1u<<shift)-1);
+  halfway=1u<<(shift-1);
+  if (rest>halfway || (rest==halfway && (half & 1)))
+    half++;
+  return(sign | half);
+}
+
+float fp16ToFloat(uint16_t code) {
+  union {float f; uint32_t u;} v;
+  uint32_t exponent=(code>>10) & 0x1F,mantissa=code & 0x3FF;
+  if (exponent==0x1F)
+    v.u=0x7F800000 | mantissa<<13;
+  else if (exponent!=0)
+    v.u=(exponent+112)<<23 | mantissa<<13;
+  else
+    v.f=mantissa*(1.0f/16777216);     // subnormal
+  v.u|=(uint32_t)(code & 0x8000)<<16;
+  return(v.f);
+}
+
+void decodeLTMRow(trialContext *ctx,int item,int first,int size,float values[]) {
+  // Decode units first..first+size-1 of the LTM codes of an item (first is a multiple of 16)
+  int i=0;
+  if (param_precision==precisionInt8) {
+    const int8_t *codes=(const int8_t *)ctx->ltmCodes+(size_t)item*itemStride+first;
+    float scale=ctx->ltmScales[item];
+#if defined(__AVX2__)
+    for(;i+8<=size;i+=8)
+      _mm256_storeu_ps(values+i,_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(codes+i)))),_mm256_set1_ps(scale)));
+#endif
+    for(;i<size;i++)
+      values[i]=codes[i]*scale;
+  }
+  else {
+    const uint16_t *codes=(const uint16_t *)ctx->ltmCodes+(size_t)item*itemStride+first;
+#if defined(__AVX2__)
+    if (param_precision==precisionBF16)
+      for(;i+8<=size;i+=8)
+	_mm256_storeu_ps(values+i,_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)(codes+i))),16)));
+#if defined(__F16C__)
+    else
+      for(;i+8<=size;i+=8)
+	_mm256_storeu_ps(values+i,_mm256_cvtph_ps(_mm_load_si128((const __m128i *)(codes+i))));
+#endif
+#endif
+    for(;i<size;i++)
+      values[i]=param_precision==precisionBF16 ? bf16ToFloat(codes[i]) : fp16ToFloat(codes[i]);
+  }
+}
+
+#if defined(__AVX2__)
+static inline __m256 loadCodes(const void *row,int i,int precision,__m256 scale) {
+  // Units i..i+7 of a row of codes (i is a multiple of 8)
+  if (precision==precisionInt8)
+    return(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)((const int8_t *)row+i)))),scale));
+#if defined(__F16C__)
+  if (precision==precisionFP16)
+    return(_mm256_cvtph_ps(_mm_load_si128((const __m128i *)((const uint16_t *)row+i))));
+#endif
+  return(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_load_si128((const __m128i *)((const uint16_t *)row+i))),16)));
+}
+#endif
+
+void encodeLTMRow(trialContext *ctx,int item) {
+  // Code the LTM representation of an item at the storage precision, and set its norm to the
+  // norm of the decoded representation
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  int j;
+  if (param_precision==precisionInt8) {
+    int8_t *codes=(int8_t *)ctx->ltmCodes+(size_t)item*itemStride;
+    float largest=0;
+    for(j=0;j<nbItemUnits;j++)
+      largest=fmaxf(largest,fabsf(itemVectorsInLTM[item][j]));
+    ctx->ltmScales[item]=largest>0 ? largest/127 : 1;
+    for(j=0;j<itemStride;j++)
+      codes[j]=(int8_t)rintf(itemVectorsInLTM[item][j]/ctx->ltmScales[item]);
+  }
+  else {
+    uint16_t *codes=(uint16_t *)ctx->ltmCodes+(size_t)item*itemStride;
+    for(j=0;j<itemStride;j++)
+      codes[j]=param_precision==precisionBF16 ? floatToBF16(itemVectorsInLTM[item][j]) : floatToFP16(itemVectorsInLTM[item][j]);
+  }
+  decodeLTMRow(ctx,item,0,itemStride,ctx->decodedRow);
+  ctx->ltmNorms[item]=dotProduct(ctx->decodedRow,ctx->decodedRow,itemStride);
+}
+
+float ltmSquaredDistance(trialContext *ctx,const float wmVector[],int item,int size,float bound) {
+  // squaredDistance() between a WM vector and the LTM representation of an item, at the storage
+  // precision. With AVX2, the codes are decoded in registers (fp16 needs F16C), otherwise one
+  // block of the early abandon at a time
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  float block[abandonBlock] __attribute__((aligned(arenaAlignment)));
+  float somme=0;
+  int i=0,n;
+  if (param_precision==precisionFP32)
+    return(squaredDistance(wmVector,itemVectorsInLTM[item],size,bound));
+#if defined(__AVX2__) && defined(__F16C__)
+  const void *row=(const char *)ctx->ltmCodes+codeSize()*item*itemStride;
+#elif defined(__AVX2__)
+  const void *row=param_precision==precisionFP16 ? NULL : (const char *)ctx->ltmCodes+codeSize()*item*itemStride;
+#endif
+#if defined(__AVX2__)
+  __m256 scale=_mm256_set1_ps(param_precision==precisionInt8 ? ctx->ltmScales[item] : 1);
+  while (row!=NULL && i+8<=size && somme<bound) {
+    int end=min(i+abandonBlock,size);
+    __m256 acc=_mm256_setzero_ps();
+    for(;i+8<=end;i+=8) {
+      __m256 d=_mm256_sub_ps(_mm256_load_ps(wmVector+i),loadCodes(row,i,param_precision,scale));
+      acc=_mm256_add_ps(acc,_mm256_mul_ps(d,d));
+    }
+    somme+=horizontalSum256(acc);
+  }
+#endif
+  for(;i<size && somme<bound;i+=n) {
+    n=min(abandonBlock,size-i);
+    decodeLTMRow(ctx,item,i,n,block);
+    somme+=squaredDistance(wmVector+i,block,n,INFINITY);
+  }
+  return(somme);
+}
+
+float ltmDotProduct(trialContext *ctx,const float wmVector[],int item) {
+  // dotProduct() of a WM vector and the LTM representation of an item, at the storage precision
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  if (param_precision==precisionFP32)
+    return(dotProduct(wmVector,itemVectorsInLTM[item],itemStride));
+  decodeLTMRow(ctx,item,0,itemStride,ctx->decodedRow);
+  return(dotProduct(wmVector,ctx->decodedRow,itemStride));
+}
+
+void updateLTMNorm(trialContext *ctx,int item) {
+  // Must be called each time the LTM representation of an item is modified (codes it too)
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  if (param_precision==precisionFP32)
+    ctx->ltmNorms[item]=dotProduct(itemVectorsInLTM[item],itemVectorsInLTM[item],itemStride);
+  else
+    encodeLTMRow(ctx,item);
+  ctx->ltmVersions[item]=++ctx->cacheClock;  // the closest LTM items found so far may have changed
+}
+
+int continueNearestLTMItem(trialContext *ctx,float wmVector[],int firstItem,int nbItems,int bestItem,float *best) {
+  // Exact and norms methods: compare items firstItem..nbItems with the WM vector, the closest
+  // item so far being bestItem at distance *best. Return the closest item and update *best.
+  // Going on from items 1..firstItem-1 gives the same result as comparing all the items at once
+  int item;
+  float distance;
+
+  if (param_nearest==nearestExact) {
+    for(item=firstItem;item<=nbItems;item++) {
+      distance=ltmSquaredDistance(ctx,wmVector,item,itemStride,*best);
+      if (distance<*best) {
+	*best=distance;
+	bestItem=item;
+      }
+    }
+  }
+  else {  // nearestNorms
+    float wmNorm=dotProduct(wmVector,wmVector,itemStride);
+    for(item=firstItem;item<=nbItems;item++) {
+      distance=wmNorm+ctx->ltmNorms[item]-2*ltmDotProduct(ctx,wmVector,item);
+      if (distance<*best) {
+	*best=distance;
+	bestItem=item;
+      }
+    }
+  }
+  return(bestItem);
+}
+
+int nearestLTMItem(trialContext *ctx,float wmVector[],int nbItems,float *minDistance) {
+  // Return the LTM item (1..nbItems) closest to the WM vector (the first one in case of ties)
+  // and its squared distance. Whole rows are compared: their padding units are 0
+  profilePhase(ctx,profileNearest);
+  int item,bestItem=0;
+  float distance,best=INFINITY;
+
+  if (param_nearest!=nearestPrefix)
+    bestItem=continueNearestLTMItem(ctx,wmVector,1,nbItems,0,&best);
+  else {  // nearestPrefix
+    int prefixDims=min(param_prefixDims,nbItemUnits);
+    int shortlistSize=min(param_shortlist,nbItems);
+    int shortlist[shortlistSize];
+    float shortlistDistances[shortlistSize];
+    int nbCandidates=0,c;
+    for(item=1;item<=nbItems;item++) {  // keep the closest items on the first dimensions, sorted
+      float bound=(nbCandidates==shortlistSize) ? shortlistDistances[shortlistSize-1] : INFINITY;
+      distance=ltmSquaredDistance(ctx,wmVector,item,prefixDims,bound);
+      if (distance<bound) {
+	c=(nbCandidates==shortlistSize) ? shortlistSize-1 : nbCandidates++;
+	for(;c>0 && shortlistDistances[c-1]>distance;c--) {
+	  shortlist[c]=shortlist[c-1];
+	  shortlistDistances[c]=shortlistDistances[c-1];
+	}
+	shortlist[c]=item;
+	shortlistDistances[c]=distance;
+      }
+    }
+    for(c=0;c<nbCandidates;c++) {  // exact distances of the shortlisted items
+      distance=ltmSquaredDistance(ctx,wmVector,shortlist[c],itemStride,best);
+      if (distance<best || (distance==best && shortlist[c]<bestItem)) {
+	best=distance;
+	bestItem=shortlist[c];
+      }
+    }
+  }
+  *minDistance=best;
+  return(bestItem);
+}
+
+
+/******************/
+/* REFRESH CACHES */
+/******************/
+// A refresh retrieves the positions again and again while only one row of associations and one
+// WM representation change at each step. Each change gets a new version from the clock of the
+// context (64 bits, so versions are never reused), and what retrieve() computed from a row is
+// kept with the version of the row: it is valid as long as the row has that version. A closest
+// LTM item is kept with the clock of its search: it is valid for the items compared as long as
+// they and the WM item have no newer version, and a new distractor is just compared with it
+void rowChanged(trialContext *ctx,int item) {
+  // Must be called each time the row of an item in itemPositionMatrix is modified
+  ctx->rowVersions[item]=++ctx->cacheClock;
+}
+
+void wmChanged(trialContext *ctx,int item) {
+  // Must be called each time the WM representation of an item is modified
+  ctx->wmVersions[item]=++ctx->cacheClock;
+}
+
+void resetCaches(trialContext *ctx) {
+  // Invalidate everything cached, at the start of a trial
   int i;
-  float rmse=0,diff;
-  for(i=1;i<=size;i++) {
-    diff=(v1[i]-v2[i]);
-    rmse+=diff*diff;
+  for(i=0;i<=maxItem;i++) {
+    rowChanged(ctx,i);
+    wmChanged(ctx,i);
+    ctx->ltmVersions[i]=++ctx->cacheClock;
+  }
+}
+
+float *cachedActivations(trialContext *ctx,int pos,int nbItems) {
+  // Sums of the associations of items 1..nbItems with position pos (before decay). Only the
+  // rows changed since the sums were cached are summed again
+  int (*positionCodes)[nbUnitBlocks]=(void *)ctx->positionCodes;
+  float (*itemPositionMatrix)[positionStride]=(void *)ctx->itemPositionMatrix;
+  float *sums=ctx->activationCache+(size_t)pos*(maxItem+1);
+  uint64_t *stamps=ctx->activationStamps+(size_t)pos*(maxItem+1);
+  int item;
+  for(item=1;item<=nbItems;item++)
+    if (stamps[item]!=ctx->rowVersions[item]) {
+      sums[item]=positionActivation(positionCodes[pos],itemPositionMatrix[item]);
+      stamps[item]=ctx->rowVersions[item];
+    }
+  return(sums);
+}
+
+int cachedNearestLTMItem(trialContext *ctx,int wmItem,int nbItems,float *minDistance) {
+  // nearestLTMItem() of the WM representation of an item, searched again only if that
+  // representation or the LTM items compared have changed. Items added since the search are
+  // compared with its result (exact and norms methods)
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+  nearestEntry *entry=&ctx->nearestCache[wmItem];
+  int item,valid=ctx->wmVersions[wmItem]<=entry->stamp && entry->nbItems<=nbItems;
+  profileCount(ctx,profileNearestLookups);
+  for(item=1;valid && item<=entry->nbItems;item++)
+    valid=ctx->ltmVersions[item]<=entry->stamp;
+  if (!valid || (entry->nbItems<nbItems && param_nearest==nearestPrefix))
+    entry->item=nearestLTMItem(ctx,itemVectorsInWM[wmItem],nbItems,&entry->distance);
+  else if (entry->nbItems<nbItems)
+    entry->item=continueNearestLTMItem(ctx,itemVectorsInWM[wmItem],entry->nbItems+1,nbItems,entry->item,&entry->distance);
+  entry->stamp=ctx->cacheClock;
+  entry->nbItems=nbItems;
+  *minDistance=entry->distance;
+  return(entry->item);
+}
+
+
+/***************/
+/* EVENT TRACE */
+/***************/
+static inline void recordEvent(trialContext *ctx,int type,int position,int item,int other,float value) {
+  // Add an event to the ring of the trial, if the trial is traced
+  if (__builtin_expect(ctx->recording,0)) {
+    traceEvent *event=&ctx->events[ctx->nbEvents++ & (eventRingSize-1)];
+    event->time=ctx->globalTime;
+    event->value=value;
+    event->type=type;
+    event->unused=0;
+    event->position=position;
+    event->item=item;
+    event->other=other;
   }
-  return(sqrt(rmse/size));
 }
 
+
 /*********/
 /* DECAY */
 /*********/
-void decay(float itemPositionMatrix[][nbPositionUnits+1],float factor,int excludedItem) {
+// Decay is lazy. Decaying the associations by a factor only multiplies the decay level of the
+// context. The row of an item in itemPositionMatrix is stored as it was at decay level
+// rowLevels[item]: its actual values are the stored ones times decayScale(). A row is brought
+// up to date with updateRow() before being modified.
+#define minDecayLevel 1e-100        // all the rows are brought up to date below this level
+
+void resetDecay(trialContext *ctx) {
+  int i;
+  ctx->decayLevel=1;
+  for(i=0;i<=ctx->nbActiveItems;i++)
+    ctx->rowLevels[i]=1;
+}
+
+float decayScale(trialContext *ctx,int item) {
+  // Decay not applied yet to the row of an item
+  return(ctx->decayLevel/ctx->rowLevels[item]);
+}
+
+float *updateRow(trialContext *ctx,int item) {
+  // Apply the pending decay to the row of an item and return the row
+  float (*itemPositionMatrix)[positionStride]=(void *)ctx->itemPositionMatrix;
+  int j;
+  if (ctx->rowLevels[item]!=ctx->decayLevel) {
+    float factor=decayScale(ctx,item);
+    for(j=0;j<positionStride;j++)
+      itemPositionMatrix[item][j]*=factor;
+    ctx->rowLevels[item]=ctx->decayLevel;
+    rowChanged(ctx,item);
+  }
+  return(itemPositionMatrix[item]);
+}
+
+void decay(trialContext *ctx,float factor,int excludedItem) {
   // Decay item position associations
-  int i,j;
-  for(i=1;i<=maxItem;i++)
-    if (excludedItem ==-1 || i!=excludedItem) {   // do not decay the current item
-      for(j=1;j<=nbPositionUnits;j++)
-        if (itemPositionMatrix[i][j]!=0)
-          itemPositionMatrix[i][j]*=factor;
-    }
+  int i;
+  profilePhase(ctx,profileDecay);
+  recordEvent(ctx,eventDecay,0,excludedItem,0,factor);
+  ctx->decayLevel*=factor;
+  if (excludedItem!=-1)   // do not decay the current item: its pending decay does not change
+    ctx->rowLevels[excludedItem]*=factor;
+  if (ctx->decayLevel<minDecayLevel) {
+    for(i=0;i<=ctx->nbActiveItems;i++)
+      updateRow(ctx,i);
+    resetDecay(ctx);
+  }
+}
+
+
+/****************/
+/* ACTIVE ITEMS */
+/****************/
+void activateItem(trialContext *ctx,int item) {
+  // Initialize the rows of a new item of the trial, with no association and no LTM features,
+  // and add it to the active items
+  float (*itemPositionMatrix)[positionStride]=(void *)ctx->itemPositionMatrix;
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  int j;
+  for(j=0;j<positionStride;j++)
+    itemPositionMatrix[item][j]=0;
+  ctx->rowLevels[item]=ctx->decayLevel;
+  rowChanged(ctx,item);
+  memcpy(itemVectorsInLTM[item],ctx->unknownPattern,sizeof(float)*itemStride);  // -1: the item is not characterized along those dimensions
+  if (param_precision==precisionFP32)
+    ctx->ltmNorms[item]=ctx->unknownNorm;
+  else
+    encodeLTMRow(ctx,item);
+  ctx->ltmVersions[item]=++ctx->cacheClock;
+  ctx->itemStrength[item]=0;
+  ctx->nbActiveItems=item;
+}
+
+void createDistractorPattern(trialContext *ctx,int distractor,int refItem) {
+  // LTM representation of a distractor, overlapping the WM representation of refItem. The
+  // pattern is built in the scratch row of the context, on top of the current one, and the LTM
+  // items only change (and the closest LTM items found so far are only invalidated) if it differs
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  profileCount(ctx,profileDistractorPatterns);
+  memcpy(ctx->patternScratch,itemVectorsInLTM[distractor],sizeof(float)*itemStride);
+  interferenceModels[param_interference].createPattern(ctx,ctx->patternScratch,itemVectorsInWM[refItem]);
+  if (memcmp(ctx->patternScratch,itemVectorsInLTM[distractor],sizeof(float)*itemStride)) {
+    memcpy(itemVectorsInLTM[distractor],ctx->patternScratch,sizeof(float)*itemStride);
+    updateLTMNorm(ctx,distractor);
+  }
+}
+
+void newDistractor(trialContext *ctx) {
+  // Next distractor of the trial. Its representation is created when it is encoded
+  ctx->distractorNumber++;
+  activateItem(ctx,maxMemoranda+ctx->distractorNumber);
 }
 
 
 /*************/
 /* INTERFERE */
 /*************/
-void interfere(float oldItemVector[], float newItemVector[], float p) {
+// A feature moves only if it differs and is known in both vectors: (int)x==-1, i.e. x in ]-2,-1],
+// marks the units along which an item is not characterized. The kernels compute the moved value
+// of every unit and keep the old one where the mask is off, with the same arithmetic as the
+// scalar code
+#define interferenceBlock 256   // units of the rows updated together by interfereWithAll
+
+kernel int interfereUnits(float oldItemVector[], const float newItemVector[], float p, int first, int end) {
+  // Move the features first..end-1 of the old item vector towards the new ones by a proportion p
+  // Return 1 if a feature has changed
+  int j=first,changed=0;
+  float q=1-p;
+#if defined(__AVX512F__)
+  __m512 vq=_mm512_set1_ps(q),vp=_mm512_set1_ps(p),low=_mm512_set1_ps(-2),high=_mm512_set1_ps(-1);
+  for(;j+16<=end;j+=16) {
+    __m512 o=_mm512_loadu_ps(oldItemVector+j),n=_mm512_loadu_ps(newItemVector+j);
+    __mmask16 mask=_mm512_cmp_ps_mask(o,n,_CMP_NEQ_UQ)
+      & ~(_mm512_cmp_ps_mask(o,low,_CMP_GT_OQ) & _mm512_cmp_ps_mask(o,high,_CMP_LE_OQ))
+      & ~(_mm512_cmp_ps_mask(n,low,_CMP_GT_OQ) & _mm512_cmp_ps_mask(n,high,_CMP_LE_OQ));
+    __m512 value=_mm512_add_ps(_mm512_mul_ps(o,vq),_mm512_mul_ps(n,vp));
+    changed|=(_mm512_cmp_ps_mask(value,o,_CMP_NEQ_UQ) & mask)!=0;
+    _mm512_storeu_ps(oldItemVector+j,_mm512_mask_blend_ps(mask,o,value));
+  }
+#elif defined(__AVX2__)
+  __m256 vq=_mm256_set1_ps(q),vp=_mm256_set1_ps(p),low=_mm256_set1_ps(-2),high=_mm256_set1_ps(-1);
+  for(;j+8<=end;j+=8) {
+    __m256 o=_mm256_loadu_ps(oldItemVector+j),n=_mm256_loadu_ps(newItemVector+j);
+    __m256 unknown=_mm256_or_ps(_mm256_and_ps(_mm256_cmp_ps(o,low,_CMP_GT_OQ),_mm256_cmp_ps(o,high,_CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(n,low,_CMP_GT_OQ),_mm256_cmp_ps(n,high,_CMP_LE_OQ)));
+    __m256 mask=_mm256_andnot_ps(unknown,_mm256_cmp_ps(o,n,_CMP_NEQ_UQ));
+    __m256 value=_mm256_add_ps(_mm256_mul_ps(o,vq),_mm256_mul_ps(n,vp));
+    changed|=_mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(value,o,_CMP_NEQ_UQ),mask))!=0;
+    _mm256_storeu_ps(oldItemVector+j,_mm256_blendv_ps(o,value,mask));
+  }
+#elif defined(__ARM_NEON)
+  float32x4_t vq=vdupq_n_f32(q),vp=vdupq_n_f32(p),low=vdupq_n_f32(-2),high=vdupq_n_f32(-1);
+  for(;j+4<=end;j+=4) {
+    float32x4_t o=vld1q_f32(oldItemVector+j),n=vld1q_f32(newItemVector+j);
+    uint32x4_t unknown=vorrq_u32(vandq_u32(vcgtq_f32(o,low),vcleq_f32(o,high)),vandq_u32(vcgtq_f32(n,low),vcleq_f32(n,high)));
+    uint32x4_t mask=vbicq_u32(vmvnq_u32(vceqq_f32(o,n)),unknown);
+    float32x4_t value=vaddq_f32(vmulq_f32(o,vq),vmulq_f32(n,vp));
+    changed|=vmaxvq_u32(vandq_u32(vmvnq_u32(vceqq_f32(value,o)),mask))!=0;
+    vst1q_f32(oldItemVector+j,vbslq_f32(mask,value,o));
+  }
+#elif defined(__SSE2__)
+  __m128 vq=_mm_set1_ps(q),vp=_mm_set1_ps(p),low=_mm_set1_ps(-2),high=_mm_set1_ps(-1);
+  for(;j+4<=end;j+=4) {
+    __m128 o=_mm_loadu_ps(oldItemVector+j),n=_mm_loadu_ps(newItemVector+j);
+    __m128 unknown=_mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(o,low),_mm_cmple_ps(o,high)),_mm_and_ps(_mm_cmpgt_ps(n,low),_mm_cmple_ps(n,high)));
+    __m128 mask=_mm_andnot_ps(unknown,_mm_cmpneq_ps(o,n));
+    __m128 value=_mm_add_ps(_mm_mul_ps(o,vq),_mm_mul_ps(n,vp));
+    changed|=_mm_movemask_ps(_mm_and_ps(_mm_cmpneq_ps(value,o),mask))!=0;
+    _mm_storeu_ps(oldItemVector+j,_mm_or_ps(_mm_and_ps(mask,value),_mm_andnot_ps(mask,o)));
+  }
+#endif
+  for(;j<end;j++) {  // scalar fallback and tail
+    float o=oldItemVector[j],n=newItemVector[j];
+    int moves=o!=n && !(o>-2 && o<=-1) && !(n>-2 && n<=-1);
+    float value=o*q+n*p;
+    changed|=moves && value!=o;
+    oldItemVector[j]=moves ? value : o;
+  }
+  return(changed);
+}
+
+int interfere(trialContext *ctx,float oldItemVector[], float newItemVector[], float p) {
   // Move the old item vector features towards the new ones by a proportion p
-  int j;
-  for(j=1;j<=nbItemUnits;j++) {
-    //    printf("%f - %f ==>",oldItemVector[j],newItemVector[j]);
-    if ((oldItemVector[j] != newItemVector[j]) && ((int)oldItemVector[j]!=-1 && (int)newItemVector[j]!=-1))
-      oldItemVector[j]=oldItemVector[j]*(1 -p) + newItemVector[j]*p;
-    //printf("%f\n",oldItemVector[j]);
+  // Return 1 if a feature has changed
+  int size=nbItemUnits;
+  profilePhase(ctx,profileInterfere);
+  dispatchOnSize(size,interfereUnits(oldItemVector,newItemVector,p,0,size));
+}
+
+void interfereWithAll(trialContext *ctx,int newItem,float p) {
+  // The WM representation of a new memorandum interferes with the other items in WM (the
+  // memoranda before it and the distractors so far): one update of these rows, by blocks of
+  // units so that the block of the new item stays in the L1 cache
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+  int items[maxItem+1],changed[maxItem+1];
+  int i,nbItems=0,first;
+  profilePhase(ctx,profileInterfere);
+  for(i=1;i<newItem;i++)
+    items[nbItems++]=i;
+  for(i=1;i<=ctx->distractorNumber;i++)
+    items[nbItems++]=maxMemoranda+i;
+  memset(changed,0,sizeof(int)*nbItems);
+  for(first=0;first<nbItemUnits;first+=interferenceBlock)
+    for(i=0;i<nbItems;i++)
+      changed[i]|=interfereUnits(itemVectorsInWM[items[i]],itemVectorsInWM[newItem],p,first,min(first+interferenceBlock,nbItemUnits));
+  for(i=0;i<nbItems;i++)
+    if (changed[i])
+      wmChanged(ctx,items[i]);
+  if (VERBOSE && nbItems>0) {
+    printf("   All items are altered by the new encoded item.\n");
+    for(i=0;i<nbItems;i++)
+      displayItemUnits(itemVectorsInWM,items[i]);
   }
 }
 
@@ -333,48 +1875,36 @@ void interfere(float oldItemVector[], float newItemVector[], float p) {
 /************/
 /* RETRIEVE */
 /************/
-int retrieve(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],int pos,int status, float *activationMax, float *retrievalDuration,int *bestWMItem) {
+int retrieve(trialContext *ctx,int pos,int status, float *activationMax, float *retrievalDuration,int *bestWMItem) {
   // Retrieve an item at given position (pos)
   // Status=1 ==> retrieve for refresh ; Status=0 ==> retrieve for recall
   // First, determine which WM item is best associated to the current position (bestWMItem)
   // Then, identify which LTM item is most similar to that WM item and returns it
+  int distractorNumber=ctx->distractorNumber;
   
-  int bestItem=-1;
-  char item;
-  float somme;
-  int i,j;
+  int item;
+  profilePhase(ctx,profileRetrieve);
   if (status==0) {   // retrieval during recall (retrieval during refreshing has its own duration)
-    float var_r=randomNormal(param_R,param_s);
+    float var_r=randomNormal(ctx,ctx->param.R,ctx->param.s);
     if (var_r<.1)
       var_r=.1;
-    var_tr=logTauE/var_r;   // cf Eq. 3a in Oberauer & Lewandowsky (2010)
-    if (var_tr > presentationTime)
-      var_tr=presentationTime;
+    ctx->var_tr=ctx->param.logTauE/var_r;   // cf Eq. 3a in Oberauer & Lewandowsky (2010)
+    if (ctx->var_tr > ctx->param.presentationTime)
+      ctx->var_tr=ctx->param.presentationTime;
   }
-  *retrievalDuration=var_tr;
+  *retrievalDuration=ctx->var_tr;
   *activationMax=-99999;
-  if (VERBOSE) printf("[%.2fs] ",globalTime);
-  float activationValues[maxMemoranda+distractorNumber+1];
-  for(item=1;item<=maxMemoranda+distractorNumber;item++) {  // activation values of each item are computed
-    somme=0;
-
-    // compute activation from position units
-    for(i=1;i<=nbPositionUnits;i++)
-      if (positionVectors[pos][i]!=0)
-	somme+=positionVectors[pos][i] * itemPositionMatrix[item][i];
+  if (VERBOSE) printf("[%.2fs] ",ctx->globalTime);
 
-    // add noise
-    somme+=randomNormal(0,1) * max(param_sigma,.0001);
-
-    if (VERBOSE)
-      activationValues[item]=somme;
-    
-    // get maximum value
-    if (somme > *activationMax) {
-      *activationMax=somme;
-      *bestWMItem=item;
-    }
-  }
+  // activation values of each item are computed, with noise, and the maximum is kept
+  // The noise is drawn for all items at once (its scale is set by prepareParameters())
+  randomNormals(ctx,ctx->retrievalNoise+1,maxMemoranda+distractorNumber);
+  for(item=1;item<=maxMemoranda+distractorNumber;item++)
+    ctx->activationScales[item]=decayScale(ctx,item);
+  float *sums=cachedActivations(ctx,pos,maxMemoranda+distractorNumber);
+  int bestActivatedItem=maxActivation(sums,ctx->activationScales,maxMemoranda+distractorNumber,ctx->retrievalNoise,ctx->param.noiseScale,ctx->traceActivations,activationMax);
+  if (bestActivatedItem!=-1)
+    *bestWMItem=bestActivatedItem;
 
   // display activation values
   if (VERBOSE) {
@@ -388,11 +1918,11 @@ int retrieve(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
 	printf(RED);
       if (item <= 26 && item<=maxMemoranda) {  // memoranda
 	printf("%c:",item+'A'-1);
-	pr2(activationValues[item]);
+	pr2(ctx->traceActivations[item]);
       }
       else if (item > maxMemoranda) {// distractors
 	printf("%d:",item-maxMemoranda);
-	pr2(activationValues[item]);
+	pr2(ctx->traceActivations[item]);
       }
       if (item == *bestWMItem)
 	printf(RESET);
@@ -404,27 +1934,22 @@ int retrieve(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
     printf("\n");
 
   int retrievedItem;
-  if (*activationMax < param_theta) {
+  if (*activationMax < ctx->param.theta) {
     retrievedItem=0;
+    profileCount(ctx,profileFailedRetrievals);
     if (VERBOSE) printf("No memoranda are above the theta threshold.\n");
   }
   else {
     // Comparison between the retrieved item and the stable LTM item representations
-    float minRmse=99999;
-    float aRmse;
-    for(item=1;item<=maxMemoranda+distractorNumber;item++) {
-      aRmse=rmse(itemVectorsInWM[*bestWMItem],itemVectorsInLTM[item],nbItemUnits);
-      if (aRmse<minRmse) {
-	minRmse=aRmse;
-	retrievedItem=item;
-      }
-    }
+    float minDistance;
+    retrievedItem=cachedNearestLTMItem(ctx,*bestWMItem,maxMemoranda+distractorNumber,&minDistance);
     if (VERBOSE) {
       printf("   ");
-      printf(CYN "Pos%d: %c (%.2f) is the closest LTM item to the best WM item (%c) (RMSE=%.4f)" RESET,pos,name(retrievedItem),*activationMax,name(*bestWMItem),minRmse);
+      printf(CYN "Pos%d: %c (%.2f) is the closest LTM item to the best WM item (%c) (RMSE=%.4f)" RESET,pos,name(retrievedItem),*activationMax,name(*bestWMItem),sqrt(minDistance/nbItemUnits));
       printf("\n");
     }
   }
+  recordEvent(ctx,eventRetrieval,pos,retrievedItem,*bestWMItem,*activationMax);
   return(retrievedItem);
 }
 
@@ -432,12 +1957,19 @@ int retrieve(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
 /**********/
 /* ENCODE */
 /**********/
-float encode(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],int initialEncoding,int currentItem,int bestWMItem,int position,float timeLeft,int strengthDivisor,float duration, int distractor) {
+#define distractorAtPosition 2  // autopilot: the distractor of the step, already created, only associated with the position
+
+float encode(trialContext *ctx,int initialEncoding,int currentItem,int bestWMItem,int position,float timeLeft,int strengthDivisor,float duration, int distractor) {
   // Encode the current symbol in given position
   // Return the encodingDuration
-  // distractor = 1 if it is the encoding of a distractor
-  int i,j,retrievedItem,currentItemSymbol;
+  // distractor = 1 if it is the encoding of a distractor, distractorAtPosition to associate the
+  // distractor encoded by the step with another position (no retrieval, pattern or interference)
+  int (*positionCodes)[nbUnitBlocks]=(void *)ctx->positionCodes;
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  int i,j,k,retrievedItem,currentItemSymbol;
   float encodingDuration, factor,var_r,retrievalDuration,activationMax;
+  profilePhase(ctx,profileEncode);
 
   if (distractor)
     currentItemSymbol=currentItem-maxMemoranda+'0';
@@ -445,7 +1977,7 @@ float encode(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
     currentItemSymbol=currentItem+'A'-1;
 
   // compute the value of r which is drawn from the mean R
-  var_r=randomNormal(param_R,param_s);
+  var_r=randomNormal(ctx,ctx->param.R,ctx->param.s);
   if (var_r<.1)
     var_r=.1;
 
@@ -455,75 +1987,71 @@ float encode(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
     }
     else {
     // copy LTM representation into WM at initial encoding
-      for (j=1;j<=nbItemUnits;j++)
+      for (j=0;j<nbItemUnits;j++)
 	itemVectorsInWM[currentItem][j]=itemVectorsInLTM[currentItem][j];    
-      var_te=logTauE/var_r;
-      if (var_te > presentationTime)
-	var_te=presentationTime;
-      encodingDuration=var_te;
+      wmChanged(ctx,currentItem);
+      ctx->var_te=ctx->param.logTauE/var_r;
+      if (ctx->var_te > ctx->param.presentationTime)
+	ctx->var_te=ctx->param.presentationTime;
+      encodingDuration=ctx->var_te;
 
-      if (VERBOSE) printf("[%.2fs]   (%d) Encoding duration of %c = %1.3f\n",globalTime,distractor,currentItemSymbol,encodingDuration);
+      if (VERBOSE) printf("[%.2fs]   (%d) Encoding duration of %c = %1.3f\n",ctx->globalTime,distractor,currentItemSymbol,encodingDuration);
 
-    var_eta=1-exp(-var_r*encodingDuration);
+    ctx->var_eta=1-modelExp(-var_r*encodingDuration);
     }
 
-    // new item interfere with all other items
-    // NOT USED FOR THE MOMENT. KEEP THE CODE THOUGH.
-    //    for(i=1;i<=maxMemoranda+distractorNumber;i++)
-    //      interfere(itemVectorsInWM[i],itemVectorsInWM[currentItem],.4);
-    //    if (VERBOSE) {
-    //      printf("   All items are altered by the new encoded item.\n");
-    //      for(i=1;i<=lastItem;i++)
-    //	if (i!=currentItem)
-    // displayItemUnits(itemVectorsInWM,i);
-    // }
+    // new item interfere with all other items (interference memoranda)
+    if (!distractor && interferenceModels[param_interference].memorandaInterfere)
+      interfereWithAll(ctx,currentItem,param_interferenceWeight);
 
   } // reencoding
   else {   // reencoding during refreshing
     if (duration == -1) {  // duration is not given and has to be computed
-      var_tr=-log(1-var_tauR)/var_r;             // cf Eq. 3a in Oberauer & Lewandowsky (2010)
-      if (var_tr > timeLeft)
-	var_tr=timeLeft;
-      encodingDuration=var_tr;
+      ctx->var_tr=ctx->param.logTauR/var_r;             // cf Eq. 3a in Oberauer & Lewandowsky (2010)
+      if (ctx->var_tr > timeLeft)
+	ctx->var_tr=timeLeft;
+      encodingDuration=ctx->var_tr;
     }
     else 
       encodingDuration=duration;
-    var_eta=1-exp(-var_r*encodingDuration);  // vaut param_tauR la plupart du temps sauf quand var_te > presentationTime
-    var_eta/=strengthDivisor;  // if more than one item is considered at the same time, divise the strength accordingly
+    ctx->var_eta=1-modelExp(-var_r*encodingDuration);  // vaut param_tauR la plupart du temps sauf quand var_te > presentationTime
+    ctx->var_eta/=strengthDivisor;  // if more than one item is considered at the same time, divise the strength accordingly
   }
 
-  globalTime+=encodingDuration;
+  ctx->globalTime+=encodingDuration;
 
   // Decay during encoding of memoranda
   if (!distractor && duration == -1)  // do not decay if duration is given, which means it has been done before
-    decay(itemPositionMatrix,exp(-param_D * encodingDuration),currentItem);
+    decay(ctx,modelExp(-ctx->param.D * encodingDuration),currentItem);
 
   // Encoding of a distractor	    
   // first, retrieve the WM memoranda at current position, then alter it with distractor
   int tmp;
-  if (distractor) {
-    retrievedItem=retrieve(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,position,1,&activationMax,&retrievalDuration,&tmp);
+  if (distractor==1) {
+    retrievedItem=retrieve(ctx,position,1,&activationMax,&retrievalDuration,&tmp);
 
     // create distractor pattern
-    if (param_sameDist == 1) { // distractors are all the same
-      if (distractorNumber == 0) { // first distractor of the trial
-	distractorNumber=1;
-	createOverlapingRandomPattern(itemVectorsInLTM[maxMemoranda+distractorNumber],itemVectorsInWM[retrievedItem],nbItemUnits,param_itemDistractorOverlap);
+    if (ctx->param.sameDist == 1) { // distractors are all the same
+      if (ctx->distractorNumber == 0) { // first distractor of the trial
+	newDistractor(ctx);
+	createDistractorPattern(ctx,maxMemoranda+ctx->distractorNumber,retrievedItem);
       }
     }
     else // distractors are different from each other
-      createOverlapingRandomPattern(itemVectorsInLTM[maxMemoranda+distractorNumber],itemVectorsInWM[retrievedItem],nbItemUnits,param_itemDistractorOverlap);
+      createDistractorPattern(ctx,maxMemoranda+ctx->distractorNumber,retrievedItem);
+    int distractorNumber=ctx->distractorNumber;
 
     // copy LTM representation into WM
-    for (j=1;j<=nbItemUnits;j++)
-      itemVectorsInWM[maxMemoranda+distractorNumber][j]=itemVectorsInLTM[maxMemoranda+distractorNumber][j];    
+    memcpy(itemVectorsInWM[maxMemoranda+distractorNumber],itemVectorsInLTM[maxMemoranda+distractorNumber],sizeof(float)*itemStride);
+    wmChanged(ctx,maxMemoranda+distractorNumber);
 
     if (VERBOSE) {
       displayItemUnits(itemVectorsInWM,maxMemoranda+distractorNumber);
-      displayItemUnits(itemVectorsInWM,lastItem);
+      displayItemUnits(itemVectorsInWM,ctx->lastItem);
     }
     
-    interfere(itemVectorsInWM[retrievedItem],itemVectorsInWM[maxMemoranda+distractorNumber],distractorEncodingWeight);
+    if (interfere(ctx,itemVectorsInWM[retrievedItem],itemVectorsInWM[maxMemoranda+distractorNumber],ctx->param.distractorWeight))
+      wmChanged(ctx,retrievedItem);
     
     if (VERBOSE) {
       printf("   ");
@@ -532,19 +2060,33 @@ float encode(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
       displayItemUnits(itemVectorsInWM,retrievedItem);
     }
 
-    var_eta*=distractorEncodingWeight;   // distractor are weakly encoded
+    ctx->var_eta*=ctx->param.distractorWeight;   // distractor are weakly encoded
+    recordEvent(ctx,eventDistractor,position,maxMemoranda+distractorNumber,retrievedItem,ctx->var_eta);
   }
+  else if (distractor) {
+    if (VERBOSE)
+      printf("   Distractor %c is also associated with position %d\n",currentItemSymbol,position);
+    recordEvent(ctx,eventDistractor,position,currentItem,0,ctx->var_eta);
+  }
+  else if (initialEncoding)
+    recordEvent(ctx,eventEncode,position,currentItem,0,encodingDuration);
+  else
+    recordEvent(ctx,eventRefresh,position,currentItem,bestWMItem,encodingDuration);
 
-  // Create or update association links between items and positions
-  for(j=1;j<=nbPositionUnits;j++)                
-    if (positionVectors[position][j] != 0)
-      itemPositionMatrix[currentItem][j]+=(param_L-itemPositionMatrix[currentItem][j])*var_eta;
+  // Create or update association links between items and the active units of the position
+  float *associations=updateRow(ctx,currentItem);
+  for(k=0;k<nbUnitBlocks;k++) {
+    j=positionCodes[position][k];
+    associations[j]+=(ctx->param.L-associations[j])*ctx->var_eta;
+  }
+  rowChanged(ctx,currentItem);
  
   // Update item representation: get closer to the LTM representation
   if (!initialEncoding && !distractor) { //  refreshing
     if (VERBOSE)
       printf("   Move WM item %c closer to LTM item %c\n", name(bestWMItem),name(currentItem));
-    interfere(itemVectorsInWM[bestWMItem],itemVectorsInLTM[currentItem],.5);
+    if (interfere(ctx,itemVectorsInWM[bestWMItem],itemVectorsInLTM[currentItem],.5))
+      wmChanged(ctx,bestWMItem);
     if (VERBOSE)
       displayItemUnits(itemVectorsInWM,bestWMItem);
   }
@@ -555,146 +2097,154 @@ float encode(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nb
 /*******************************/
 /* COMPARE STIMULUS AND RECALL */
 /*******************************/
-float compareStimAndRecalled(char recalled[],int lastPosition,float resSerialPositionData[]) {
-  // Compare the recalled sequence with the stimulus ("ABC...") and return the proportion correct
+int compareStimAndRecalled(int recalled[],int lastPosition,long serialPositionCount[]) {
+  // Compare the recalled items with the stimulus (item i at position i) and return the number of
+  // items recalled at their position. Counts are kept as integers so that the sums over
+  // replications do not depend on the order in which the workers add them
   int i;
   int sommeOrdre=0;
   for (i=0;i<=lastPosition-1;i++)
-    if (recalled[i] == 'A'+i) {
+    if (recalled[i] == i+1) {
       sommeOrdre++;
-      resSerialPositionData[i+1]++;
+      serialPositionCount[i+1]++;
     }
-  return((float)sommeOrdre/lastPosition);
+  return(sommeOrdre);
 }
 
 /***********/
 /* REFRESH */
 /***********/
-int refresh(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],float timeAvailable,int lastPosition) {
-  // Refresh an item
-  int currentPosition=1;
-  int cpi,afsi;
+// A refresh is a sequence of steps. Each step retrieves the item at the next position and reencodes
+// it. Items are refreshed by groups of attentionalFocusSize, and the reencoding duration of the
+// group is taken from the time available. The state of a refresh is kept between steps so that
+// the lanes of a batch run their refreshes in lockstep (see RUN REPLICATIONS)
+void startRefresh(refreshState *r,float timeAvailable) {
+  r->timeAvailable=timeAvailable;
+  r->currentPosition=1;
+  r->afsi=0;
+}
+
+int refreshStep(trialContext *ctx,refreshState *r,int lastPosition) {
+  // Refresh the next item. Return 0 if the refresh is over
   int bestLTMItem,bestWMItem;
-  float reencodingDuration;
   float activationMax,retrievalDuration;
-  
-  while (timeAvailable > 0) {
-    afsi = min(param_attentionalFocusSize,lastPosition);
-    cpi = currentPosition;
-    reencodingDuration=-1;  // reencoding duration is not known yet. Use the previous one afterwards
+  profilePhase(ctx,profileRefresh);
+
+  if (r->afsi==0) {  // new group
+    if (r->timeAvailable <= 0)
+      return(0);
+    r->afsi = min(ctx->param.attentionalFocusSize,lastPosition);
+    r->cpi = r->currentPosition;
+    r->reencodingDuration=-1;  // reencoding duration is not known yet. Use the previous one afterwards
+  }
 
-    while (afsi > 0) {
-      bestLTMItem=retrieve(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,cpi,1,&activationMax,&retrievalDuration,&bestWMItem);
+  bestLTMItem=retrieve(ctx,r->cpi,1,&activationMax,&retrievalDuration,&bestWMItem);
       
-      if (VERBOSE) {
-	printf("   ");
-	printf(CYN "It is refreshed." RESET);
-	printf("\n");
-      }
-      reencodingDuration=encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,0,bestLTMItem,bestWMItem,cpi,timeAvailable,min(param_attentionalFocusSize,lastPosition),reencodingDuration,0);
+  if (VERBOSE) {
+    printf("   ");
+    printf(CYN "It is refreshed." RESET);
+    printf("\n");
+  }
+  r->reencodingDuration=encode(ctx,0,bestLTMItem,bestWMItem,r->cpi,r->timeAvailable,min(ctx->param.attentionalFocusSize,lastPosition),r->reencodingDuration,0);
 
-      if (VERBOSE)
-	printf("   %c is reencoded in %1.3f ms\n",name(bestLTMItem),reencodingDuration);
-      cpi++;
-      if (cpi > lastPosition)
-	cpi=1;
-      afsi--;
-    }
-    currentPosition=cpi;
-    timeAvailable-=reencodingDuration;
-    if (timeAvailable < 0)
-      timeAvailable=0;
+  if (VERBOSE)
+    printf("   %c is reencoded in %1.3f ms\n",name(bestLTMItem),r->reencodingDuration);
+  r->cpi++;
+  if (r->cpi > lastPosition)
+    r->cpi=1;
+  r->afsi--;
+
+  if (r->afsi==0) {  // end of the group
+    r->currentPosition=r->cpi;
+    r->timeAvailable-=r->reencodingDuration;
+    if (r->timeAvailable < 0)
+      r->timeAvailable=0;
   }
+  return(r->afsi>0 || r->timeAvailable>0);
 }
 
-
 /**************/
 /* PROCESSING */
 /**************/
-float processing(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],int lastPosition) {
+float processing(trialContext *ctx,int lastPosition) {
 
   int i,j;
   float factor;
-  var_Rop=-log(1-param_tauOp)/param_Ta;    
-  var_rop=randomNormal(var_Rop,param_s);  //draw a random value r >=.1
-  if (var_rop<.1)
-    var_rop=.1;
-  var_ta=-log(1-param_tauOp)/var_rop;             // cf Eq. 3a in Oberauer & Lewandowsky (2010)
-  if ((var_ta > param_freeTime) && (param_freeTimeIncludesOpDuration==1)) {
-    if (VERBOSE) printf("   Process stopped. Planned to last %1.3f ms but no free time left.\n",var_ta);
-    var_ta=param_freeTime;
+  profilePhase(ctx,profileProcessing);
+  ctx->var_rop=randomNormal(ctx,ctx->param.Rop,ctx->param.s);  //draw a random value r >=.1
+  if (ctx->var_rop<.1)
+    ctx->var_rop=.1;
+  ctx->var_ta=ctx->param.logTauOp/ctx->var_rop;             // cf Eq. 3a in Oberauer & Lewandowsky (2010)
+  if ((ctx->var_ta > ctx->param.freeTime) && (ctx->param.freeTimeIncludesOpDuration==1)) {
+    if (VERBOSE) printf("   Process stopped. Planned to last %1.3f ms but no free time left.\n",ctx->var_ta);
+    ctx->var_ta=ctx->param.freeTime;
   }
-  if (VERBOSE) printf("[%.2fs]   Processing duration=%1.3f\n",globalTime,var_ta);
+  if (VERBOSE) printf("[%.2fs]   Processing duration=%1.3f\n",ctx->globalTime,ctx->var_ta);
+  recordEvent(ctx,eventProcessing,lastPosition,maxMemoranda+ctx->distractorNumber,0,ctx->var_ta);
 
   // create distractor pattern
-  //  createOverlapingRandomPattern(itemVectorsInWM[maxMemoranda+distractorNumber],itemVectorsInWM[lastItem],nbItemUnits,param_itemDistractorOverlap);
+  //  createOverlapingRandomPattern(itemVectorsInWM[maxMemoranda+distractorNumber],itemVectorsInWM[lastItem],nbItemUnits,ctx->param.itemDistractorOverlap);
   
   //if (VERBOSE) {
   //displayItemUnits(itemVectorsInWM,maxMemoranda+distractorNumber);
   //displayItemUnits(itemVectorsInWM,lastItem);
   //}
   
-  // Encode distractor
-  float encodingDuration=encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,1,maxMemoranda+distractorNumber,-1,lastPosition,9999,1,var_ta,1);
+  // Encode distractor (autopilot: then associate it with the other positions of the list)
+  encode(ctx,1,maxMemoranda+ctx->distractorNumber,-1,lastPosition,9999,1,ctx->var_ta,1);
+  for(i=1;param_processing==processingAutopilot && i<lastPosition;i++)
+    encode(ctx,1,maxMemoranda+ctx->distractorNumber,-1,i,9999,1,ctx->var_ta,distractorAtPosition);
 
-  globalTime += var_ta;
+  ctx->globalTime += ctx->var_ta;
 
   // all items decay
-  decay(itemPositionMatrix,exp(-param_D*var_ta),-1);
+  decay(ctx,modelExp(-ctx->param.D*ctx->var_ta),-1);
 
-  return(var_ta);
+  return(ctx->var_ta);
 }
 
-/*
-// CRUDE AUTOPILOT MODE CODE
-float processing(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],int lastPosition) {
-
-  int i,j;
-  float factor;
-  var_Rop=-log(1-param_tauOp)/param_Ta;    
-  var_rop=randomNormal(var_Rop,param_s);  //draw a random value r >=.1
-  if (var_rop<.1)
-    var_rop=.1;
-  var_ta=-log(1-param_tauOp)/var_rop;             // cf Eq. 3a in Oberauer & Lewandowsky (2010)
-  if ((var_ta > param_freeTime) && (param_freeTimeIncludesOpDuration==1)) {
-    if (VERBOSE) printf("   Process stopped. Planned to last %1.3f ms but no free time left.\n",var_ta);
-    var_ta=param_freeTime;
-  }
-  if (VERBOSE) printf("[%.2fs]   Processing duration=%1.3f\n",globalTime,var_ta);
-
-  // Encode distractor at all positions
-  float encodingDuration = 0;
-  for (int pos = 1; pos <= nbPositionUnits; pos++) {
-    encodingDuration += encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,1,maxMemoranda+distractorNumber,pos,lastPosition,9999,1,var_ta,1);
-  }
-
-  globalTime += var_ta;
 
-  // all items decay
-  decay(itemPositionMatrix,exp(-param_D*var_ta),-1);
+/**********/
+/* RECALL */
+/**********/
+#define recalledNothing -1  // no item above the threshold at a position
 
-  return(var_ta);
+char recallCode(int item) {
+  // Character coding a recalled item in the results: letter of a memorandum, '*' for another
+  // item, '.' if nothing was recalled
+  if (item==recalledNothing)
+    return('.');
+  if ((item>=1) && (item<=26))
+    return(item+'A'-1);
+  return('*');
 }
 
-*/
+void codeRecall(int recalled[],int lastPosition,char codes[]) {
+  // Recalled items as a string of codes
+  int position;
+  for(position=0;position<lastPosition;position++)
+    codes[position]=recallCode(recalled[position]);
+  codes[lastPosition]='\0';
+}
 
-/**********/
-/* RECALL */
-/**********/
-void recall(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbItemUnits+1],float itemVectorsInLTM[][nbItemUnits+1],float itemPositionMatrix[][nbPositionUnits+1],float itemStrength[],int lastPosition, char recalled[maxPosition+1]) {
+void recall(trialContext *ctx,int lastPosition, int recalled[maxPosition]) {
+  // Recall the items of positions 1..lastPosition: recalled[position-1] is the item, or
+  // recalledNothing
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
   int i,j,position,codeItem;
   int bestLTMItem;
   int bestWMItem;
   float retrievalDuration,activationMax,factor;
+  profilePhase(ctx,profileRecall);
 
   for(position=1;position<=lastPosition;position++) {  // items are recalled according to their position
-    bestLTMItem=retrieve(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,position,0,&activationMax,&retrievalDuration,&bestWMItem);
+    bestLTMItem=retrieve(ctx,position,0,&activationMax,&retrievalDuration,&bestWMItem);
     if (retrievalDuration > 5)
       retrievalDuration=5;
 
     // decay during recall
-    decay(itemPositionMatrix,exp(-param_D*retrievalDuration),-1);
-    //    factor=exp(-param_D*retrievalDuration);
+    decay(ctx,modelExp(-ctx->param.D*retrievalDuration),-1);
+    //    factor=exp(-ctx->param.D*retrievalDuration);
     //    for(i=1;i<=maxItem;i++) {
     //      itemStrength[i]*=factor;
     //  for(j=1;j<=nbPositionUnits;j++) 
@@ -702,29 +2252,28 @@ void recall(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbI
     //	  itemPositionMatrix[i][j]*=factor;
     //}
 
-    if (activationMax > param_theta) {
-      if ((bestLTMItem>=1) && (bestLTMItem<=26))
-	codeItem=bestLTMItem+'A'-1;
-      else 
-	codeItem='*';
+    if (activationMax > ctx->param.theta) {
+      codeItem=bestLTMItem;
       // Response suppression
       //      for (i=1;i<=nbItemUnits;i++)
       //if (positionVectors[position][i] != 0)
-      for(j=1;j<=nbPositionUnits;j++)
+      float *associations=updateRow(ctx,bestLTMItem);
+      for(j=0;j<nbPositionUnits;j++)
 	if (itemVectorsInWM[bestLTMItem][j] != 0)
-	  itemPositionMatrix[bestLTMItem][j]-=param_L*activationMax;
+	  associations[j]-=ctx->param.L*activationMax;
+      rowChanged(ctx,bestLTMItem);
     }
     else
-      codeItem='.';
+      codeItem=recalledNothing;
     if (VERBOSE) {
       printf("   ");
-      printf(RED "position %d: %c is retrieved" RESET,position,codeItem);
+      printf(RED "position %d: %c is retrieved" RESET,position,recallCode(codeItem));
       printf("\n");
     }
     recalled[position-1]=codeItem;
-    globalTime+=retrievalDuration;
+    recordEvent(ctx,eventRecall,position,codeItem==recalledNothing ? 0 : bestLTMItem,0,activationMax);
+    ctx->globalTime+=retrievalDuration;
   }
-  recalled[lastPosition]='\0';
 }
 
 	
@@ -732,32 +2281,21 @@ void recall(int positionVectors[][nbPositionUnits+1],float itemVectorsInWM[][nbI
 /*************************************/
 /* GENERATE POSITION REPRESENTATIONS */
 /*************************************/
-void generatePositionRepresentations(int positionVectors[][nbPositionUnits+1]) {
-  int i,j,p,randomPosition,oldPosition;
+void generatePositionRepresentations(trialContext *ctx) {
+  // Each position has one active unit per block. From one position to the next, a block keeps
+  // its active unit with probability ctx->param.P, otherwise a new one is drawn
+  int (*positionCodes)[nbUnitBlocks]=(void *)ctx->positionCodes;
+  int i,p;
   
-  for(i=1;i<=nbPositionUnits;i++)
-    positionVectors[1][i]=0;
-  for(i=0;i<=nbUnitBlocks-1;i++) {
-    randomPosition=1+rand()%sizeOfPositionBlocks;
-    positionVectors[1][i*sizeOfPositionBlocks+randomPosition]=1;
-  }
+  for(i=0;i<=nbUnitBlocks-1;i++)
+    positionCodes[1][i]=i*sizeOfPositionBlocks+randomBelow(ctx,sizeOfPositionBlocks);
   
   for(p=2;p<=maxPosition;p++) {
     for(i=0;i<=nbUnitBlocks-1;i++) {
-      if (rand()%100>param_P*100) {  //if the block has to be changed
-	for(j=i*sizeOfPositionBlocks+1;j<=(i+1)*sizeOfPositionBlocks;j++) {
-	  //	  if (positionVectors[p-1][j]==1) 
-	  //  oldPosition=j; //previous position of the 1 is memorized
-	  positionVectors[p][j]=0;  // its units are set to 0
-	}
-	randomPosition=1+rand()%sizeOfPositionBlocks;  // and a new "1" is added
-	positionVectors[p][i*sizeOfPositionBlocks+randomPosition]=1;
-      }
-      else {  // the block has to remain unchanged
-	for(j=i*sizeOfPositionBlocks+1;j<=(i+1)*sizeOfPositionBlocks;j++) {
-	  positionVectors[p][j] = positionVectors[p-1][j]; // it is the same as the previous one
-	}
-      }
+      if (randomBelow(ctx,100)>ctx->param.P*100)  //if the block has to be changed, a new "1" is drawn
+	positionCodes[p][i]=i*sizeOfPositionBlocks+randomBelow(ctx,sizeOfPositionBlocks);
+      else  // the block has to remain unchanged
+	positionCodes[p][i]=positionCodes[p-1][i];
     }
   }
   
@@ -766,8 +2304,8 @@ void generatePositionRepresentations(int positionVectors[][nbPositionUnits+1]) {
     printf("POSITION UNITS\n");
     for(p=1;p<=maxPosition;p++) {
       printf("   [%2d] ",p);
-      for(i=1;i<=nbPositionUnits;i++) 
-	printf("%d",positionVectors[p][i]);
+      for(i=0;i<nbPositionUnits;i++) 
+	printf("%d",positionCodes[p][i/sizeOfPositionBlocks]==i);
       printf("\n");
     }
   }
@@ -776,22 +2314,31 @@ void generatePositionRepresentations(int positionVectors[][nbPositionUnits+1]) {
 /*********************************/
 /* GENERATE ITEM REPRESENTATIONS */
 /*********************************/
-void generateItemRepresentations(float itemVectors[][nbItemUnits+1], float d1, float d2) {
+void generateItemRepresentations(trialContext *ctx, float d1, float d2) {
   // generate distributed representations for all items, d1% in domain 1, d2% in domain 2 - mark
    // Items in domain 1 use unit indexes from 1 to nbItemUnits/4
    // Items in domain 2 use unit indexes from nbItemUnits/4+1 to nbItemUnits/2
-  int i,j,p;
+  float (*itemVectors)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  int i,j,p,rows[maxMemoranda+1];
+  for(i=1;PRESET==itemsEmbeddings && i<=maxMemoranda;i++)  // rows of the embeddings, distinct if they are drawn
+    do {
+      rows[i]=param_drawMemoranda ? memorandaPool[randomBelow(ctx,memorandaPoolSize)] : memorandaPool[i-1];
+      for(j=1;j<i && rows[j]!=rows[i];j++);
+    } while (param_drawMemoranda && j<i);
   for(i=1;i<=maxMemoranda;i++) { // memoranda
-    for(j=1;j<=nbItemUnits;j++)
+    for(j=0;j<nbItemUnits;j++)
       itemVectors[i][j]=-1; 
     //   if (i%2==1) // Item in domain 1
     if (1) // Item in domain 1
-      if(!PRESET)
-        createRandomPattern(itemVectors[i],1,nbItemUnits); // basically only in domain 1 -- used to be nbitemunits/4
+      if(PRESET==itemsRandom)
+        createRandomPattern(ctx,itemVectors[i],0,nbItemUnits-1); // basically only in domain 1 -- used to be nbitemunits/4
+      else if (PRESET==itemsClassic)
+        createRandomPattern(ctx,itemVectors[i],0,nbItemUnits/4-1);
       else{
-        for(int jj=1;jj<=nbItemUnits;jj++){
-          itemVectors[i][jj]=embeddingsList[i-1][jj-1];
-          //printf("%d", embeddingsList[i-1][jj-1]);
+        const float *embedding=embeddingRow(&embeddings,rows[i]);
+        for(int jj=0;jj<nbItemUnits;jj++){
+          itemVectors[i][jj]=embedding[jj];
+          //printf("%d", embedding[jj-1]);
         }
       }
     //else // Item in domain 2
@@ -799,13 +2346,14 @@ void generateItemRepresentations(float itemVectors[][nbItemUnits+1], float d1, f
       
   }
   
-  for(i=maxMemoranda+1;i<=maxItem;i++) { // distractors. They will be instantiated on the fly
-    for (j=1;j<=nbItemUnits;j++)
-      itemVectors[i][j]=-1;  // meaning that the item is not characterized along those dimensions
-  }
+  // distractors are instantiated on the fly (see newDistractor)
+  for(i=1;i<=maxMemoranda;i++)
+    updateLTMNorm(ctx,i);
 
   // DISPLAY
   if (VERBOSE) {
+    for(i=1;PRESET==itemsEmbeddings && embeddings.words && i<=maxMemoranda;i++)
+      printf("%c=%s%s",'A'+i-1,embeddings.words[rows[i]],i<maxMemoranda ? " " : "\n");
     printf("ITEM UNITS (first however many units)\n");
     for(p=1;p<=min(26,maxMemoranda);p++) // why's it min(26, maxMemoranda) here
       displayItemUnits(itemVectors,p);
@@ -813,300 +2361,2501 @@ void generateItemRepresentations(float itemVectors[][nbItemUnits+1], float d1, f
 }
 
 
-/********/
-/* MAIN */
-/********/
-int main(int argc,char* argv[]) {
-  printf("running");
+/****************/
+/* RESULTS SINK */
+/****************/
+// Each context writes the recalls of its replications in its own writer. A writer keeps the records
+// in memory and moves them to a temporary file when its buffer is full. Each job remembers the part
+// of the writer it has written (see SWEEP), and the parts are copied to the trials file in the order
+// of the jobs: the file does not depend on the number of threads
 
-  float span;
-   span = 0;
-   int nbmemo_in;
-   
-   int k;
-   for(k=1;k<=nbmemo;k++){
-    nbmemo_in = k;
-    printf("%i",nbmemo);
+void openWriter(resultWriter *writer) {
+  writer->buffer=malloc(resultBufferSize);
+  if (writer->buffer==NULL)
+    error("Cannot allocate a result buffer.","");
+  writer->used=0;
+  writer->spill=NULL;
+  writer->spilled=0;
+}
 
-  nbPositionUnits=nbUnitBlocks*sizeOfPositionBlocks;  // number of units in the position layer
+void closeWriter(resultWriter *writer) {
+  free(writer->buffer);
+  if (writer->spill)
+    fclose(writer->spill);
+}
 
-  float itemPositionMatrix[maxItem+1][nbPositionUnits+1];
-  float itemStrength[maxItem+1];   // WM representations of item strengths
-  int nbSimulations=500;
-  int positionVectors[maxPosition+1][nbPositionUnits+1];
-  float itemVectorsInWM[maxItem+1][nbItemUnits+1];    // WM representations of items
-  float itemVectorsInLTM[maxItem+1][nbItemUnits+1];   // LTM representations of items
-  int lastPosition;
-  int i,j;
+long writerPosition(resultWriter *writer) {
+  // Number of bytes written so far
+  return(writer->spilled+writer->used);
+}
 
-  // READ EMBEDDINGS LIST FROM FILE
+void flushWriter(resultWriter *writer) {
+  // Move the buffer to the spill file
+  if (writer->used==0)
+    return;
+  if (writer->spill==NULL && (writer->spill=tmpfile())==NULL)
+    error("Cannot create a temporary file for the results.","");
+  if (fwrite(writer->buffer,1,writer->used,writer->spill)!=writer->used)
+    error("Cannot write the temporary results.","");
+  writer->spilled+=writer->used;
+  writer->used=0;
+}
 
+void appendToWriter(resultWriter *writer,const void *record,size_t size) {
+  if (writer->used+size>resultBufferSize)
+    flushWriter(writer);
+  memcpy(writer->buffer+writer->used,record,size);
+  writer->used+=size;
+}
 
-  #define ROWS maxMemoranda
-  #define COLS nbItemUnits
+void copyWriterPart(resultWriter *writer,long offset,long length,FILE *out) {
+  // Write length bytes from offset of a writer to out. The writer must have been flushed if records were spilled
+  char block[65536];
+  size_t size;
+  if (writer->spill==NULL) {
+    fwrite(writer->buffer+offset,1,length,out);
+    return;
+  }
+  fseek(writer->spill,offset,SEEK_SET);
+  for(;length>0;length-=size) {
+    size=fread(block,1,length<(long)sizeof(block) ? length : sizeof(block),writer->spill);
+    if (size==0)
+      error("Cannot read the temporary results.","");
+    fwrite(block,1,size,out);
+  }
+  fseek(writer->spill,0,SEEK_END);
+}
 
-  
-  FILE *fp;
-  int ik, jk;
-  float **arr;
+void writeUint32LE(unsigned char *bytes,uint32_t value) {
+  bytes[0]=value;
+  bytes[1]=value>>8;
+  bytes[2]=value>>16;
+  bytes[3]=value>>24;
+}
+
+uint64_t readUint64LE(const unsigned char *bytes) {
+  return(readUint32LE(bytes) | (uint64_t)readUint32LE(bytes+4)<<32);
+}
+
+void writeUint64LE(unsigned char *bytes,uint64_t value) {
+  writeUint32LE(bytes,value);
+  writeUint32LE(bytes+4,value>>32);
+}
+
+void writeTrial(trialContext *ctx,int replication,char recalled[]) {
+  // Record the recall of a replication
+  // Binary record: point and replication (little-endian uint32), length of the recall (1 byte), recall
+  char record[maxPosition+64];
+  int size;
+  if (resultFormat==resultFormatText) {
+    if (VERBOSE) {  // displayed with the trace
+      fprintf(stderr,"#%4d: Recalled = %s\n",replication,recalled);
+      return;
+    }
+    size=snprintf(record,sizeof(record),"#%4d: Recalled = %s\n",replication,recalled);
+  }
+  else if (resultFormat==resultFormatCSV)
+    size=snprintf(record,sizeof(record),"%d,%d,%s\n",ctx->pointNumber,replication,recalled);
+  else {
+    size=strlen(recalled);
+    writeUint32LE((unsigned char *)record,ctx->pointNumber);
+    writeUint32LE((unsigned char *)record+4,replication);
+    record[8]=size;
+    memcpy(record+9,recalled,size);
+    size+=9;
+  }
+  appendToWriter(&ctx->results,record,size);
+}
+
+void writeUint16LE(unsigned char *bytes,uint16_t value) {
+  bytes[0]=value;
+  bytes[1]=value>>8;
+}
 
-  // Open the file for reading
-  fp = fopen("pca_embeddings_c.txt", "r");
-  if (fp == NULL) {
-      printf("Error opening file\n");
-      return 1;
+void writeTrialEvents(trialContext *ctx,trialContext *trial,int replication) {
+  // Record the events of a traced replication run by trial (the context or one of its lanes): point, replication, number of events kept and
+  // number of events lost (oldest ones) as little-endian uint32, then the events of 16 bytes:
+  // time and value (float32), type, 0, position, item and other (int16)
+  unsigned char record[16];
+  long first=trial->nbEvents>eventRingSize ? trial->nbEvents-eventRingSize : 0;
+  long e;
+  uint32_t bits;
+  writeUint32LE(record,ctx->pointNumber);
+  writeUint32LE(record+4,replication);
+  writeUint32LE(record+8,trial->nbEvents-first);
+  writeUint32LE(record+12,first);
+  appendToWriter(&ctx->eventLog,record,16);
+  for(e=first;e<trial->nbEvents;e++) {
+    traceEvent *event=&trial->events[e & (eventRingSize-1)];
+    memcpy(&bits,&event->time,4);
+    writeUint32LE(record,bits);
+    memcpy(&bits,&event->value,4);
+    writeUint32LE(record+4,bits);
+    record[8]=event->type;
+    record[9]=0;
+    writeUint16LE(record+10,event->position);
+    writeUint16LE(record+12,event->item);
+    writeUint16LE(record+14,event->other);
+    appendToWriter(&ctx->eventLog,record,16);
   }
+}
 
-  // Allocate memory for the array
-  arr = (float **) malloc(ROWS * sizeof(float *));
-  for (ik = 0; ik < ROWS; ik++) {
-      arr[ik] = (float *) malloc(COLS * sizeof(float));
+void openResults(int withTrials) {
+  // Open the result files and write their headers (the recalls only if withTrials)
+  char fileName[strlen(resultsPrefix)+16];
+  sprintf(fileName,"%s.trials.%s",resultsPrefix,resultFormat==resultFormatBinary ? "bin" : "csv");
+  if (withTrials) {
+    if ((trialsFile=fopen(fileName,"wb"))==NULL)
+      error("Cannot create the results file: ",fileName);
+    if (resultFormat==resultFormatBinary)
+      fwrite("TBRSTRI1",1,8,trialsFile);
+    else
+      fprintf(trialsFile,"point,replication,recalled\n");
   }
+  sprintf(fileName,"%s.points.csv",resultsPrefix);
+  if ((pointsFile=fopen(fileName,"w"))==NULL)
+    error("Cannot create the results file: ",fileName);
+  fprintf(pointsFile,"point,nbSimulations,nbmemo,nbop,P,R,s,tauE,L,theta,sigma,D,Tr,tauOp,Ta,freeTime,ftiod,refreshLastStopped,attentionalFocusSize,ido,idn,sameDist,propCorrect,span,serialPositions\n");
+}
 
-  // Read data from the file
-  for (ik = 0; ik < ROWS; ik++) {
-      for (jk = 0; jk < COLS; jk++) {
-          fscanf(fp, "%f,", &arr[ik][jk]);
-      }
+void openEvents(char *fileName) {
+  if ((eventsFile=fopen(fileName,"wb"))==NULL)
+    error("Cannot create the event file: ",fileName);
+  fwrite("TBRSEVT1",1,8,eventsFile);
+}
+
+void closeResults() {
+  if (eventsFile)
+    fclose(eventsFile);
+  if (trialsFile && trialsFile!=stderr)
+    fclose(trialsFile);
+  if (pointsFile)
+    fclose(pointsFile);
+}
+
+
+/*****************/
+/* CONTEXT ARENA */
+/*****************/
+void *carveFromArena(char *arena, size_t *offset, size_t size) {
+  // Return the block of given size at offset in the arena and move offset to the next aligned block
+  void *block=arena+*offset;
+  *offset+=(size+arenaAlignment-1)/arenaAlignment*arenaAlignment;
+  return(block);
+}
+
+size_t layoutTrialContext(trialContext *ctx,char *arena) {
+  // Point the matrices of a context into an aligned block and return the size of the block.
+  // With arena=NULL, only the size is computed
+  size_t offset=0;
+  ctx->itemPositionMatrix=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1)*positionStride);
+  ctx->itemStrength=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1));
+  ctx->positionCodes=carveFromArena(arena,&offset,sizeof(int)*(maxPosition+1)*nbUnitBlocks);
+  ctx->itemVectorsInWM=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1)*itemStride);
+  ctx->itemVectorsInLTM=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1)*itemStride);
+  ctx->serialPositionCount=carveFromArena(arena,&offset,sizeof(long)*(maxPosition+1));
+  ctx->retrievalNoise=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1));
+  ctx->ltmNorms=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1));
+  ctx->ltmCodes=param_precision!=precisionFP32 ? carveFromArena(arena,&offset,codeSize()*(maxItem+1)*itemStride) : NULL;
+  ctx->ltmScales=param_precision!=precisionFP32 ? carveFromArena(arena,&offset,sizeof(float)*(maxItem+1)) : NULL;
+  ctx->decodedRow=param_precision!=precisionFP32 ? carveFromArena(arena,&offset,sizeof(float)*itemStride) : NULL;
+  ctx->rowLevels=carveFromArena(arena,&offset,sizeof(double)*(maxItem+1));
+  ctx->activationScales=carveFromArena(arena,&offset,sizeof(float)*(maxItem+1));
+  ctx->traceActivations=VERBOSE ? carveFromArena(arena,&offset,sizeof(float)*(maxItem+1)) : NULL;
+  ctx->rowVersions=carveFromArena(arena,&offset,sizeof(uint64_t)*(maxItem+1));
+  ctx->wmVersions=carveFromArena(arena,&offset,sizeof(uint64_t)*(maxItem+1));
+  ctx->ltmVersions=carveFromArena(arena,&offset,sizeof(uint64_t)*(maxItem+1));
+  ctx->unknownPattern=carveFromArena(arena,&offset,sizeof(float)*itemStride);
+  ctx->patternScratch=carveFromArena(arena,&offset,sizeof(float)*itemStride);
+  ctx->activationCache=carveFromArena(arena,&offset,sizeof(float)*(maxPosition+1)*(maxItem+1));
+  ctx->activationStamps=carveFromArena(arena,&offset,sizeof(uint64_t)*(maxPosition+1)*(maxItem+1));
+  ctx->nearestCache=carveFromArena(arena,&offset,sizeof(nearestEntry)*(maxItem+1));
+  ctx->events=eventsFile ? carveFromArena(arena,&offset,sizeof(traceEvent)*eventRingSize) : NULL;
+  return(offset);
+}
+
+void initializeUnknownPattern(trialContext *ctx) {
+  // Pattern copied into the LTM row of each new item (see activateItem)
+  int j;
+  for(j=0;j<nbItemUnits;j++)
+    ctx->unknownPattern[j]=-1;
+  ctx->unknownNorm=dotProduct(ctx->unknownPattern,ctx->unknownPattern,itemStride);
+}
+
+void allocateTrialContext(trialContext *ctx) {
+  // Allocate the matrices of a context in one aligned block, initialized to 0, and the lanes
+  // of its batches (see RUN REPLICATIONS)
+  size_t size=layoutTrialContext(ctx,NULL);
+  int l;
+  if (posix_memalign(&ctx->arena,arenaAlignment,size))
+    error("Cannot allocate the trial context.","");
+  layoutTrialContext(ctx,ctx->arena);
+  memset(ctx->arena,0,size);
+  initializeUnknownPattern(ctx);
+  openWriter(&ctx->results);
+  if (eventsFile)
+    openWriter(&ctx->eventLog);
+  ctx->nbLanes=param_batch;
+  if (param_batch==1) {
+    ctx->lanes=ctx;   // the context runs its trials itself
+    return;
   }
-  // Print the array
-  for (ik = 0; ik < ROWS; ik++) {
-      for (jk = 0; jk < COLS; jk++) {
-          printf("%f ", arr[ik][jk]);
-          embeddingsList[ik][jk] = arr[ik][jk];
-      }
-      printf("\n");
+  // The matrices of the lanes are in one block, lane after lane: each matrix of the batch is a
+  // [nbLanes][rows][stride] tensor. The lanes have no writers, their results go to the context
+  if (posix_memalign((void **)&ctx->lanes,arenaAlignment,param_batch*sizeof(trialContext)) || posix_memalign(&ctx->lanesArena,arenaAlignment,param_batch*size))
+    error("Cannot allocate the lanes of the trial context.","");
+  memset(ctx->lanes,0,param_batch*sizeof(trialContext));
+  memset(ctx->lanesArena,0,param_batch*size);
+  for(l=0;l<param_batch;l++) {
+    layoutTrialContext(&ctx->lanes[l],(char *)ctx->lanesArena+l*size);
+    initializeUnknownPattern(&ctx->lanes[l]);
   }
+}
 
-  // Free memory
-  for (ik = 0; ik < ROWS; ik++) {
-      free(arr[ik]);
+void freeTrialContext(trialContext *ctx) {
+  closeWriter(&ctx->results);
+  if (eventsFile)
+    closeWriter(&ctx->eventLog);
+  if (ctx->lanes!=ctx) {
+    free(ctx->lanesArena);
+    free(ctx->lanes);
   }
-  free(arr);
+  free(ctx->arena);
+  ctx->arena=NULL;
+}
 
 
-  // Close the file
-  fclose(fp);
-      
-      
-      
-  
+/************/
+/* SCHEDULE */
+/************/
+// The stimulus of a point is compiled into a schedule of operations, run by every trial. Item i
+// is encoded at position i; each one is followed by the operations of the design
+#define opEncode 1          // encode item at position, then refresh during the rest of the presentation
+#define opProcess 2         // process distractor item, then refresh during freeTime
+#define opRecall 3          // recall positions 1..position, ends the schedule
+typedef struct {
+  int type;
+  int item;                 // encoded item, or distractor number (1..) of the operation
+  int position;             // position of the item, or last position encoded
+  int rank;                 // number of the operation after its item (1..), for the trace
+  float freeTime;
+} trialOp;
 
-  
-  char *syntax="Syntaxe:\n\
-  ?                  this message\n\
-  -v                 verbose (disabled by default)\n\
-  -q(uiet)           only display statistics, no recall data\n\
-  nbmemo <value>     number of items (default=7)\n\
-  memoDistr <value>  percentage of memo in domain 1 (number of memo in domain 2 is nbmemo-this value)\n\
-  nbop <value>       number of operations (default=4)\n\
-  R <value>          Mean memory processing rate (default=6)\n\
-  P <value>          Proportion of units maintained from each position to the next (default=.3)\n\
-  s <value>          Standard deviation of processing rates (default=1)\n\
-  theta <value>      Retrieval threshold (default=.05)\n\
-  sigma <value>      Standard deviation of Gaussian noise added to item activations at retrieval (default=.02)\n\
-  D <value>          Decay rate (default=.5)\n\
-  Tr <value>         Mean time taken to refresh an item (default=.08)\n\
-  Ta <value>         Mean duration of attentional capture by processing steps (default=.5)\n\
-  freeTime <value>   Free time following each processing step (default=1)\n\
-  ftiod <0 or 1>     Free time can include (1) or not (0) the operation duration (default=1)\n\
-  determ <0 or 1>    Model can be deterministic (1) or not (0) (default=0)\n\
-  sameDist <0 or 1>  Indicates if distractors are identical (0) or all different (1)\n\
-  idn <value>        Standard deviation of the noise used to create distractor wrt memorand\n\
-  ido <value>        Item-distractor overlap\n"; 
+void parseDesign(char *list) {
+  // Read the operations after each item of the design option (n1,n2,...)
+  char *end=list;
+  param_designLength=0;
+  do {
+    param_design=realloc(param_design,sizeof(int)*(param_designLength+1));
+    if (param_design==NULL)
+      error("Cannot allocate the design.","");
+    param_design[param_designLength]=strtol(end,&end,10);
+    if (param_design[param_designLength++]<0 || (*end!=',' && *end!='\0'))
+      error("Bad design (numbers of operations n1,n2,...): ",list);
+  } while (*end++==',');
+}
 
-  // Analyze command line
-  i=1;
-  while (i<argc) {
-    if (!strcmp(argv[i],"?")) {error(syntax,"");i++;}
-    else if (!strcmp(argv[i],"-v")) {VERBOSE=1;i++;}
-    else if (!strcmp(argv[i],"-q")) {QUIET=1;i++;}
-    else if (!strcmp(argv[i],"-n")) {nbSimulations=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"nbmemo")) {nbmemo=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"memoDistr")) {param_memoDistr=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"nbop")) {nbop=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"R")) {param_R=atof(argv[i+1]);i+=2;} 
-    else if (!strcmp(argv[i],"P")) {param_P=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"s")) {param_s=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"D")) {param_D=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"theta")) {param_theta=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"sigma")) {param_sigma=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"Tr")) {param_Tr=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"Ta")) {param_Ta=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"freeTime")) {param_freeTime=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"ftiod")) {param_freeTimeIncludesOpDuration=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"determ")) {param_deterministic=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"sameDist")) {param_sameDist=atoi(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"idn")) {param_itemDistractorNoise=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"iio")) {param_itemItemOverlap=atof(argv[i+1]);i+=2;}
-    else if (!strcmp(argv[i],"ido")) {param_itemDistractorOverlap=atof(argv[i+1]);i+=2;}
-    else 
-      error("Unknown parameter:",argv[i]);
+int operationsAfterItem(modelParameters *p,int item) {
+  // Number of operations following the encoding of an item
+  if (param_design==NULL)
+    return(p->nbop);
+  return(param_design[(item-1)%param_designLength]);
+}
+
+trialOp *buildSchedule(modelParameters *p,int *nbOps) {
+  // Compile the stimulus of a point: nbmemo items, each followed by its operations, then recall
+  int i,j,n=0,nbDistractors=0;
+  trialOp *schedule;
+  for(i=1;i<=p->nbmemo;i++)
+    nbDistractors+=operationsAfterItem(p,i);
+  if (p->sameDist==0 && nbDistractors>maxDistractors)
+    error("Not enough distractors for the stimulus. Increase it with distractors <value>","");
+  if ((schedule=malloc(sizeof(trialOp)*(p->nbmemo+nbDistractors+1)))==NULL)
+    error("Cannot allocate the schedule of a point.","");
+  nbDistractors=0;
+  for(i=1;i<=p->nbmemo;i++) {
+    schedule[n++]=(trialOp){opEncode,i,i,0,0};
+    for(j=1;j<=operationsAfterItem(p,i);j++)
+      schedule[n++]=(trialOp){opProcess,++nbDistractors,i,j,p->freeTime};
   }
-  
-  if (nbop>16)
-    error("Cannot handle more than 16 operations.","");
+  schedule[n++]=(trialOp){opRecall,0,p->nbmemo,0,0};
+  *nbOps=n;
+  return(schedule);
+}
 
-  if (param_itemDistractorOverlap<0 || param_itemDistractorOverlap>1)
-    error("Item distractor overlap should be between 0 and 1.","");
 
-  // initialize random generator
-  
-  if (param_deterministic)
-    srand(param_deterministic);
-  else 
-    srand(time(0));    
-  
-  int cptReplic=1;
-  float resPropCorrect=0;
+/********************/
+/* RUN REPLICATIONS */
+/********************/
+// The replications are run by batches of nbLanes trials in lockstep: every lane goes through a
+// step of the stimulus before the next step starts. The number of steps of a refresh depends on
+// the durations drawn by each lane, so refreshes run in rounds of one step for each lane that is
+// still refreshing. Each lane draws from the stream of its replication, in the same order as when
+// the replications run one after the other: results do not depend on the size of the batches
+void startTrial(trialContext *ctx,rngState *stream,int replication) {
+  // Initialize a context for a replication. stream is the seed stream of the replication and is
+  // jumped to the next one
+  float (*itemPositionMatrix)[positionStride]=(void *)ctx->itemPositionMatrix;
+  int i,j;
+  startRandomStream(ctx,stream);
+  rngJump(stream);
+  ctx->recording=eventsFile && (replication-1)%param_eventSampling==0;
+  ctx->nbEvents=0;
+  ctx->globalTime=0;     // times of the trace and of the events are relative to the trial
 
-  //CREATE STIMULUS
-  char stimuli[nbmemo * (nbop+1)+1];
-  int cpt=0;
-  for(i=0;i<nbmemo;i++) {
-    stimuli[cpt++]=65+i;  // letters for memoranda
-    for(j=1;j<=nbop;j++) {
-      stimuli[cpt++]=j+'0';  //numbers for distractors
-    }
+  // Generate position representations
+  generatePositionRepresentations(ctx);
+
+  // Generate item representations (100% in domain 1, 0% in domain 2)
+  //generateItemRepresentations(ctx,ctx->param.memoDistr,1-ctx->param.memoDistr);
+  generateItemRepresentations(ctx,1,0);
+  // this above line operates on a 101x101 matrix which is rly weird
+
+  //INITIALISATION OF THE ITEM x POSITION MATRIX AND OF ITEM STRENGTHS (memoranda, distractors are initialized when they appear)
+  for(i=1;i<=maxMemoranda;i++) {
+    for(j=0;j<positionStride;j++)
+      itemPositionMatrix[i][j]=0;
+    ctx->itemStrength[i]=0;
   }
-  stimuli[cpt]='#';        //recall
-    
-  //INITIALIZE SERIAL POSITION DATA
-  float resSerialPositionData[maxPosition+1];
-  for (i=1;i<=nbmemo;i++)
-    resSerialPositionData[i]=0;
+  ctx->nbActiveItems=maxMemoranda;
+  resetDecay(ctx);
+  ctx->distractorNumber=0;
+  resetCaches(ctx);
+}
 
-  int symbol, idxstimulus;
-  float processingDuration;
-  char recalled[maxPosition+1];
+void refreshLanes(trialContext lanes[],int nbLanes,int lastPosition) {
+  // Run the refreshes started in the lanes, one step of each lane per round
+  int refreshing[nbLanes];
+  int l,nbRefreshing=nbLanes;
+  for(l=0;l<nbLanes;l++)
+    refreshing[l]=1;
+  while (nbRefreshing>0)
+    for(l=0;l<nbLanes;l++)
+      if (refreshing[l] && !refreshStep(&lanes[l],&lanes[l].refreshing,lastPosition)) {
+	refreshing[l]=0;
+	nbRefreshing--;
+      }
+}
 
-  logTauE = -log(1-param_tauE);
-  var_tauR = 1-exp(-param_R * param_Tr);
-  
-  while (cptReplic <= nbSimulations) {  
+void seekSeedStream(trialContext *ctx,rngState *stream,uint64_t seed,int replication) {
+  // Seed stream of a replication: the seed stream jumped replication-1 times. The context keeps
+  // the stream where its last replications stopped, so consecutive tasks do not start again
+  // from the seed
+  if (ctx->seedReplication==0 || ctx->seedOfStream!=seed || ctx->seedReplication>replication) {
+    rngSeed(&ctx->seedStream,seed);
+    ctx->seedReplication=1;
+    ctx->seedOfStream=seed;
+  }
+  for (;ctx->seedReplication<replication;ctx->seedReplication++)
+    rngJump(&ctx->seedStream);
+  *stream=ctx->seedStream;
+}
 
-    // Generate position representations
-    generatePositionRepresentations(positionVectors);
+void runReplications(trialContext *ctx,trialOp *schedule,uint64_t seed,int firstReplic,int lastReplic) {
+  // Run replications firstReplic to lastReplic of a schedule with the parameters of the context.
+  // Results are accumulated in the context
+  int firstOfBatch,nbLanes,l;
+  int lastPosition;
+  float processingDuration;
+  int recalled[ctx->nbLanes][maxPosition];
+  char codes[maxPosition+1];
+  rngState stream;
+  trialContext *lane;
+  trialOp *op;
 
-    // Generate item representations (100% in domain 1, 0% in domain 2)
-    //generateItemRepresentations(itemVectorsInLTM,param_memoDistr,1-param_memoDistr);
-    generateItemRepresentations(itemVectorsInLTM,1,0);
-    // this above line operates on a 101x101 matrix which is rly weird
+  // Replication n uses the seed stream jumped n-1 times, whichever worker runs it
+  seekSeedStream(ctx,&stream,seed,firstReplic);
 
-    
-    
-    //INITIALISATION OF THE ITEM x POSITION MATRIX
-    for(i=1;i<=maxItem;i++)
-      for(j=1;j<=nbPositionUnits;j++)
-	      itemPositionMatrix[i][j]=0;
-
-    //INITIALISATION OF ITEM STRENGTHS
-    for(i=1;i<=nbItemUnits;i++)
-      itemStrength[i]=0;
+  for (firstOfBatch=firstReplic;firstOfBatch<=lastReplic;firstOfBatch+=nbLanes) {
+    nbLanes=min(ctx->nbLanes,lastReplic-firstOfBatch+1);
+    for(l=0;l<nbLanes;l++) {
+      lane=&ctx->lanes[l];
+      lane->param=ctx->param;
+      startTrial(lane,&stream,firstOfBatch+l);
+    }
     
     lastPosition=0;
-    idxstimulus=0;
-    distractorNumber=0;
 
     // MAIN LOOP
-    while(1) {
-      //printf(sizeof stimuli);
-      symbol=stimuli[idxstimulus++];
+    for(op=schedule;;op++) {
 
       // Processing a memoranda
-      if (symbol>='A' && symbol <='Z') {
-        //printf("\n processing memo" + symbol + "m");
+      if (op->type==opEncode) {
         if (VERBOSE) {
-          printf(RED "\n   MEMORIZING %c   \n" RESET,symbol);
+          if (op->item<=26)
+            printf(RED "\n   MEMORIZING %c   \n" RESET,op->item+'A'-1);
+          else
+            printf(RED "\n   MEMORIZING %d   \n" RESET,op->item);
           printf("\n");
         }
-        lastPosition++;
-        lastItem=symbol-'A'+1;
-        float encodingDuration=encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,1,symbol-'A'+1,-1,lastPosition,presentationTime,1,-1,0);
-        if (VERBOSE) displayItemPosAssociations(itemPositionMatrix,lastPosition);
-        if (encodingDuration<0) 
-          error("There should be no error in initial encoding...","");
-        refresh(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,presentationTime-encodingDuration,lastPosition);
-	      if (VERBOSE) displayItemPosAssociations(itemPositionMatrix,lastPosition);
+        lastPosition=op->position;
+        for(l=0;l<nbLanes;l++) {
+          lane=&ctx->lanes[l];
+          lane->lastItem=op->item;
+          float encodingDuration=encode(lane,1,op->item,-1,lastPosition,lane->param.presentationTime,1,-1,0);
+          if (VERBOSE) displayItemPosAssociations(lane,lastPosition);
+          if (encodingDuration<0) 
+            error("There should be no error in initial encoding...","");
+          startRefresh(&lane->refreshing,lane->param.presentationTime-encodingDuration);
+        }
+        refreshLanes(ctx->lanes,nbLanes,lastPosition);
+	      if (VERBOSE) displayItemPosAssociations(ctx->lanes,lastPosition);
       }
       
       // Processing a distractor
-      else if (symbol>='0' && symbol <= '9'+7) {   // we can have up to 16 operations in a row - mark
-        //printf("\n processing distractor" + symbol + "d");
+      else if (op->type==opProcess) {
         if (VERBOSE) {
-          printf(RED "\n   PROCESSING ");
-          if (symbol > '9')
-            printf("1%c",symbol-10);
-          else 
-            printf("%c",symbol);
-          printf("   \n" RESET);
+          printf(RED "\n   PROCESSING %d   \n" RESET,op->rank);
           printf("\n");
         }
-        if (distractorNumber>maxDistractors)
-          error("number of distractors is higher than what is allowed in the program. Increase maxDistractors constant","");
-        if (param_sameDist == 0)  // distractors are different from each other
-          distractorNumber++;  
-        processingDuration=processing(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,lastPosition);
-
-        float timeLeft;
-        if (param_freeTimeIncludesOpDuration) 
-          timeLeft=param_freeTime-processingDuration;
-        else 
-          timeLeft=param_freeTime;
-        if (VERBOSE) displayItemPosAssociations(itemPositionMatrix,lastPosition);
-        
-        // autopilot
-        // Encode distractor
-        //float somethingsomething=encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,1,maxMemoranda+distractorNumber,-1,lastPosition,9999,1,timeLeft,1);
-        //decay(itemPositionMatrix,exp(-param_D*timeLeft),-1);
-        
-        // right stuff
-        refresh(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,timeLeft,lastPosition);
-        //float somethingsomething=encode(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,1,maxMemoranda+distractorNumber,-1,lastPosition,9999,1,timeLeft,1);
+        for(l=0;l<nbLanes;l++) {
+          lane=&ctx->lanes[l];
+          if (lane->distractorNumber>=maxDistractors && lane->param.sameDist == 0)
+            error("number of distractors is higher than what is allowed in the program. Increase it with distractors <value>","");
+          if (lane->param.sameDist == 0)  // distractors are different from each other
+            newDistractor(lane);
+          processingDuration=processing(lane,lastPosition);
+
+          float timeLeft;
+          if (lane->param.freeTimeIncludesOpDuration) 
+            timeLeft=op->freeTime-processingDuration;
+          else 
+            timeLeft=op->freeTime;
+          if (VERBOSE) displayItemPosAssociations(lane,lastPosition);
+          startRefresh(&lane->refreshing,timeLeft);
+        }
+        refreshLanes(ctx->lanes,nbLanes,lastPosition);
         
         // all items decay
-        if (VERBOSE) displayItemPosAssociations(itemPositionMatrix,lastPosition);
+        if (VERBOSE) displayItemPosAssociations(ctx->lanes,lastPosition);
 
 
       }
 
       // Recall
-      else if (symbol == '#') {
+      else {
 	if (VERBOSE) {
 	  printf(RED "\n   RECALL   \n" RESET);
 	  printf("\n");
 	}
-	recall(positionVectors,itemVectorsInWM,itemVectorsInLTM,itemPositionMatrix,itemStrength,lastPosition,recalled);
-	if (!QUIET) // print recall data
-	  fprintf(stderr,"#%4d: Recalled = %s\n",cptReplic,recalled);
-	resPropCorrect+=compareStimAndRecalled(recalled,lastPosition,resSerialPositionData);
+	lastPosition=op->position;
+	for(l=0;l<nbLanes;l++) {
+	  lane=&ctx->lanes[l];
+	  recall(lane,lastPosition,recalled[l]);
+	  if (trialsFile) { // record recall data
+	    codeRecall(recalled[l],lastPosition,codes);
+	    writeTrial(ctx,firstOfBatch+l,codes);
+	  }
+	  if (lane->recording)
+	    writeTrialEvents(ctx,lane,firstOfBatch+l);
+	  ctx->nbCorrect+=compareStimAndRecalled(recalled[l],lastPosition,ctx->serialPositionCount);
+	}
 	break;
       }
-      else 
-	error("Unknown symbol in stimulus","");
     }
-    
-    cptReplic++;
   }
+  ctx->seedStream=stream;  // startTrial() has jumped it to the next replication
+  ctx->seedReplication=lastReplic+1;
+}
+
+
+/**************/
+/* GPU ENGINE */
+/**************/
+#ifdef TBRS_CUDA
+void runReplicationsOnDevice(trialContext *ctx,trialOp *schedule,int nbOps,uint64_t seed,int firstReplic,int lastReplic) {
+  // Same as runReplications, the trials being run by the GPU backend (tbrs_cuda.cu)
+  modelParameters *p=&ctx->param;
+  int nbReplications=lastReplic-firstReplic+1,r,i;
+  uint64_t (*streams)[4]=malloc(sizeof(uint64_t)*4*nbReplications);
+  int *recalled=malloc(sizeof(int)*maxPosition*nbReplications);
+  tbrsCudaOp *ops=malloc(sizeof(tbrsCudaOp)*nbOps);
+  float *memoranda=NULL;
+  char codes[maxPosition+1];
+  rngState stream;
+  if (streams==NULL || recalled==NULL || ops==NULL)
+    error("Cannot allocate the replications of the GPU.","");
+  for(i=0;i<nbOps;i++)
+    ops[i]=(tbrsCudaOp){schedule[i].type==opEncode ? tbrsCudaEncode : schedule[i].type==opProcess ? tbrsCudaProcess : tbrsCudaRecall,
+			schedule[i].item,schedule[i].position,schedule[i].freeTime};
+
+  // Replication n uses the seed stream jumped n-1 times, as on the CPU
+  seekSeedStream(ctx,&stream,seed,firstReplic);
+  for (r=0;r<nbReplications;r++) {
+    memcpy(streams[r],stream.s,sizeof(stream.s));
+    rngJump(&stream);
+  }
+  ctx->seedStream=stream;
+  ctx->seedReplication=lastReplic+1;
+  if (PRESET==itemsEmbeddings) {  // the memoranda are the first rows of the pool
+    if ((memoranda=malloc(sizeof(float)*maxMemoranda*nbItemUnits))==NULL)
+      error("Cannot allocate the memoranda of the GPU.","");
+    for(i=0;i<maxMemoranda;i++)
+      memcpy(memoranda+(size_t)i*nbItemUnits,embeddingRow(&embeddings,memorandaPool[i]),sizeof(float)*nbItemUnits);
+  }
+  tbrsCudaPoint point={maxPosition,maxMemoranda,maxDistractors,nbItemUnits,
+		       p->P,p->R,p->s,p->L,p->theta,p->sigma,p->D,p->tauOp,p->freeTime,p->freeTimeIncludesOpDuration,
+		       p->attentionalFocusSize,p->nbmemo,p->presentationTime,p->itemDistractorOverlap,p->itemDistractorNoise,
+		       p->sameDist,p->distractorWeight,p->logTauE,p->tauR,p->Rop,ops,nbOps,memoranda};
+  const char *failure=tbrsCudaRunReplications(&point,streams,nbReplications,recalled);
+  if (failure)
+    error("GPU engine:",(char *)failure);
 
-  // DISPLAY RESULTS
-  // Headings
-  printf("NBSimulations NbMemo NbOp ProportionCorrect P R s tauE L theta sigma D Tr tauOp Ta freeTime ftIncludesOp refreshLastStopped attentionalFocusSize ");
+  for (r=0;r<nbReplications;r++) {
+    int *trial=recalled+(size_t)r*maxPosition;
+    if (trialsFile) { // record recall data
+      codeRecall(trial,p->nbmemo,codes);
+      writeTrial(ctx,firstReplic+r,codes);
+    }
+    ctx->nbCorrect+=compareStimAndRecalled(trial,p->nbmemo,ctx->serialPositionCount);
+  }
+  free(ops);
+  free(memoranda);
+  free(recalled);
+  free(streams);
+}
+#endif
 
-  // Data
-  printf("\n"); 
-  printf("%d %d %d %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %d %d %d ",nbSimulations,nbmemo_in,nbop,resPropCorrect/nbSimulations,param_P,param_R,param_s,param_tauE,param_L,param_theta,param_sigma,param_D,param_Tr,param_tauOp,param_Ta,param_freeTime,param_freeTimeIncludesOpDuration,param_refreshLastStopped,param_attentionalFocusSize);
-  printf("\n");
 
-  printf("Span \n"); 
-  for(i=1;i<=nbmemo_in;i++)
-    printf("Pos%d ",i);
-  printf("\n"); 
-  
-  for(i=1;i<=nbmemo_in;i++)
-    printf("%1.4f ",resSerialPositionData[i]/nbSimulations);
-  printf("\n");
-  span = span + resPropCorrect/nbSimulations;
-  printf("%1.4f",span);
-   }
+/*********/
+/* SWEEP */
+/*********/
+// A run simulates a list of parameter points (a single one, except in sweep mode) with a pool of
+// worker threads, each one with its own context. All the points use the same random streams:
+// replication n of every point starts from the seed stream jumped n-1 times.
+// The replications of all the points form one sequence of tasks (task t = replication
+// firstReplication+t%nbSimulations of point t/nbSimulations). It is split in one range per worker. A range is
+// one atomic word: the owner takes jobs from its front, and a worker whose range is empty
+// steals the back half of the largest range, both with a compare-and-swap. A job covers about
+// taskDuration of work (from the time of the last replications of the point), within a point
+#define taskDuration .01    // seconds of work taken at once: the scheduling cost (a few atomic operations) is well below 1%
+typedef struct {
+  modelParameters param;   // parameters of the point
+  trialOp *schedule;       // operations of a trial (see SCHEDULE)
+  int nbOps;
+  _Atomic long nbCorrect;  // results summed over the replications of the point (atomic additions of the workers)
+  _Atomic long *serialPositionCount; // [maxPosition+1]
+  _Atomic uint64_t profile[profileWords]; // profileCounts of the replications (profile 1)
+} parameterPoint;
+
+typedef struct {
+  long firstTask;          // tasks of the job
+  int worker;              // worker which ran the job
+  long offset;             // part of the writer of the worker holding the recalls of the job
+  long length;
+  long eventOffset;        // part of the event log of the worker holding the events of the job
+  long eventLength;
+} jobResults;
+
+typedef struct {
+  _Atomic uint64_t range;  // tasks not taken yet: first in the low 32 bits, end (excluded) in the high 32 bits
+} __attribute__((aligned(arenaAlignment))) workerRange;  // the ranges of the workers do not share cache lines
+
+typedef struct {
+  parameterPoint *points;
+  int nbPoints;
+  int firstReplication;    // replications firstReplication..firstReplication+nbSimulations-1 of each point
+  int nbSimulations;
+  uint64_t seed;
+  int nbWorkers;
+  workerRange *ranges;     // [nbWorkers]
+  _Atomic long untaken;    // tasks in the ranges
+  int minJob;              // smallest job (a batch of lanes, a whole point on the GPU)
+} jobQueue;
+
+typedef struct {
+  int index;
+  trialContext *ctx;       // context owned by the worker
+  jobQueue *queue;
+  jobResults *jobs;        // jobs run by the worker, in the order it ran them
+  int nbJobs;
+  int maxJobs;
+  int lastPoint;           // point of the last job, -1 before the first one
+  double replicationTime;  // seconds per replication of lastPoint
+} poolWorker;
+
+char *parameterError(modelParameters *p) {
+  // Message of the first invalid parameter of a point, NULL if they are all valid
+  if (p->nbop<0)
+    return("The number of operations should be positive.");
+  if (p->attentionalFocusSize<1)
+    return("The attentional focus size should be at least 1.");
+  if (p->itemDistractorOverlap<0 || p->itemDistractorOverlap>1)
+    return("Item distractor overlap should be between 0 and 1.");
+  if (p->nbmemo<1 || p->nbmemo>maxMemoranda || p->nbmemo>maxPosition)
+    return("The number of items should be between 1 and the number of memoranda and positions.");
+  return(NULL);
+}
+
+void prepareParameters(modelParameters *p) {
+  // Check the parameters of a point and compute the model variables
+  char *message=parameterError(p);
+  if (message)
+    error(message,"");
+  p->logTauE = -log(1-p->tauE);
+  p->tauR = 1-exp(-p->R * p->Tr);
+  p->Rop=-log(1-p->tauOp)/p->Ta;    
+  p->logTauR=-log(1-p->tauR);
+  p->logTauOp=-log(1-p->tauOp);
+  // Note that max() works on ints, so the noise is scaled by 0 unless sigma >= 1: this is the
+  // behavior of the original TBRS* code and it is kept
+  p->noiseScale=max(p->sigma,.0001);
+}
+
+void initializePoint(parameterPoint *point,modelParameters *p) {
+  // Prepare a point and compile its stimulus
+  point->param=*p;
+  prepareParameters(&point->param);
+  point->schedule=buildSchedule(&point->param,&point->nbOps);
+  point->serialPositionCount=calloc(maxPosition+1,sizeof(_Atomic long));
+  if (point->serialPositionCount==NULL)
+    error("Cannot allocate the parameter points.","");
+  point->nbCorrect=0;
+  memset((void *)point->profile,0,sizeof(point->profile));
+}
+
+void freePoint(parameterPoint *point) {
+  free(point->schedule);
+  free((void *)point->serialPositionCount);
+}
+
+double benchClock() {  // seconds, for the benchmark and the sizes of the jobs
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return(t.tv_sec+t.tv_nsec*1e-9);
+}
+
+void startProfile() {
+  // Start of the measure of the rate of the ticks, and ITT names of the phases
+  profileStartTicks=readTicks();
+  profileStartTime=benchClock();
+#ifdef TBRS_ITT
+  int k;
+  ittDomain=__itt_domain_create("tbrs");
+  for(k=0;k<nbProfilePhases;k++)
+    ittPhases[k]=__itt_string_handle_create(profilePhaseNames[k]);
+#endif
+}
+
+double ticksPerSecond() {
+  double elapsed=benchClock()-profileStartTime;
+  return(elapsed>0 ? (readTicks()-profileStartTicks)/elapsed : 1e9);
+}
+
+void addProfile(parameterPoint *point,trialContext *ctx,long nbReplications) {
+  // Add the counts of the lanes of a context to a point, with the replications of the job, and
+  // reset them
+  int l,k;
+  ctx->lanes[0].profile.trials+=nbReplications;
+  for(l=0;l<ctx->nbLanes;l++) {
+    const uint64_t *counts=(const uint64_t *)&ctx->lanes[l].profile;
+    for(k=0;k<profileWords;k++)
+      if (counts[k])
+	atomic_fetch_add_explicit(&point->profile[k],counts[k],memory_order_relaxed);
+    memset(&ctx->lanes[l].profile,0,sizeof(profileCounts));
+  }
+}
+
+#define packRange(first,end) ((uint64_t)(end)<<32 | (uint32_t)(first))
+#define rangeFirst(range) ((long)((range) & 0xFFFFFFFF))
+#define rangeEnd(range) ((long)((range)>>32))
+
+int takeJob(poolWorker *worker,long *first,long *count) {
+  // Take the next job from the front of the range of the worker. Return 0 if the range is empty
+  jobQueue *queue=worker->queue;
+  workerRange *own=&queue->ranges[worker->index];
+  uint64_t range=atomic_load(&own->range);
+  long size,pointEnd;
+  while (rangeFirst(range)<rangeEnd(range)) {
+    *first=rangeFirst(range);
+    pointEnd=(*first/queue->nbSimulations+1)*queue->nbSimulations;
+    if (*first/queue->nbSimulations==worker->lastPoint && worker->replicationTime>taskDuration/queue->nbSimulations)
+      size=max(queue->minJob,taskDuration/worker->replicationTime);
+    else if (*first/queue->nbSimulations==worker->lastPoint)
+      size=queue->nbSimulations;  // faster than the clock: the rest of the point
+    else
+      size=queue->minJob;  // cost of the point not known yet
+    *count=min(size,min(rangeEnd(range),pointEnd)-*first);
+    if (atomic_compare_exchange_weak(&own->range,&range,packRange(*first+*count,rangeEnd(range)))) {
+      atomic_fetch_sub(&queue->untaken,*count);
+      return(1);
+    }
+  }
+  return(0);
+}
+
+int stealRange(poolWorker *worker) {
+  // Move the back half of the largest range to the empty range of the worker. Return 0 if there
+  // was nothing to steal
+  jobQueue *queue=worker->queue;
+  uint64_t range,best=0;
+  int w,victim=-1;
+  long middle;
+  for(w=0;w<queue->nbWorkers;w++) {
+    range=atomic_load(&queue->ranges[w].range);
+    if (w!=worker->index && rangeEnd(range)-rangeFirst(range)>rangeEnd(best)-rangeFirst(best)) {
+      best=range;
+      victim=w;
+    }
+  }
+  if (victim==-1)
+    return(0);
+  middle=rangeFirst(best)+(rangeEnd(best)-rangeFirst(best))/2;
+  if (!atomic_compare_exchange_strong(&queue->ranges[victim].range,&best,packRange(rangeFirst(best),middle)))
+    return(0);  // the victim or another thief was faster: try again
+  atomic_store(&queue->ranges[worker->index].range,packRange(middle,rangeEnd(best)));
+  return(1);
+}
+
+void *runJobs(void *arg) {
+  // Worker thread: run jobs until no task is left
+  poolWorker *worker=arg;
+  trialContext *ctx=worker->ctx;
+  jobQueue *queue=worker->queue;
+  int i,pointIndex,firstReplic;
+  long first,count;
+  double start;
+  parameterPoint *point;
+  jobResults *job;
+  while (1) {
+    if (!takeJob(worker,&first,&count)) {
+      if (atomic_load(&queue->untaken)==0)
+	break;
+      if (!stealRange(worker))
+	sched_yield();
+      continue;
+    }
+    if (worker->nbJobs==worker->maxJobs) {
+      worker->maxJobs=worker->maxJobs ? 2*worker->maxJobs : 64;
+      if ((worker->jobs=realloc(worker->jobs,worker->maxJobs*sizeof(jobResults)))==NULL)
+	error("Cannot allocate the jobs.","");
+    }
+    job=&worker->jobs[worker->nbJobs++];
+    pointIndex=first/queue->nbSimulations;
+    firstReplic=queue->firstReplication+first%queue->nbSimulations;
+    point=&queue->points[pointIndex];
+    ctx->param=point->param;
+    ctx->pointNumber=nbPointsWritten+1+pointIndex;
+    ctx->nbCorrect=0;
+    memset(ctx->serialPositionCount,0,sizeof(long)*(maxPosition+1));
+    job->firstTask=first;
+    job->worker=worker->index;
+    job->offset=writerPosition(&ctx->results);
+    job->eventOffset=eventsFile ? writerPosition(&ctx->eventLog) : 0;
+    start=benchClock();
+#ifdef TBRS_CUDA
+    if (param_device==deviceCUDA)
+      runReplicationsOnDevice(ctx,point->schedule,point->nbOps,queue->seed,firstReplic,firstReplic+count-1);
+    else
+#endif
+    runReplications(ctx,point->schedule,queue->seed,firstReplic,firstReplic+count-1);
+    worker->replicationTime=(benchClock()-start)/count;
+    worker->lastPoint=pointIndex;
+    job->length=writerPosition(&ctx->results)-job->offset;
+    job->eventLength=eventsFile ? writerPosition(&ctx->eventLog)-job->eventOffset : 0;
+    // counts are integers: the sums do not depend on the order of the jobs
+    atomic_fetch_add_explicit(&point->nbCorrect,ctx->nbCorrect,memory_order_relaxed);
+    for (i=1;i<=point->param.nbmemo;i++)
+      atomic_fetch_add_explicit(&point->serialPositionCount[i],ctx->serialPositionCount[i],memory_order_relaxed);
+    if (param_profile)
+      addProfile(point,ctx,count);
+  }
+  return(NULL);
+}
+
+int compareJobs(const void *job1,const void *job2) {
+  long first1=((const jobResults *)job1)->firstTask,first2=((const jobResults *)job2)->firstTask;
+  return((first1>first2)-(first1<first2));
+}
+
+trialContext *warmContexts=NULL;  // contexts of the workers kept from a run to the next (see SERVER)
+int nbWarmContexts=0;
+int keepWarmContexts=0;
+
+void releaseWarmContexts() {
+  int w;
+  for(w=0;w<nbWarmContexts;w++)
+    freeTrialContext(&warmContexts[w]);
+  free(warmContexts);
+  warmContexts=NULL;
+  nbWarmContexts=0;
+}
+
+void runPoints(parameterPoint points[],int nbPoints,int firstReplic,int nbSimulations,uint64_t seed) {
+  // Run nbSimulations replications of each point, from replication firstReplic, and add their
+  // results to those of the points. The contexts and threads are created once for all the points
+  long nbTasks=(long)nbPoints*nbSimulations;
+  int nbThreads=min(param_nbThreads,min(nbTasks,1024));
+  int w,j,nbJobs=0;
+  if (nbTasks>INT_MAX)
+    error("Too many replications in the run (the tasks are numbered on 31 bits).","");
+  if (VERBOSE || nbThreads<1 || param_device==deviceCUDA)  // verbose output of parallel workers would be interleaved
+    nbThreads=1;                                            // and the GPU runs all the replications of a point at once
+  jobQueue queue={points,nbPoints,firstReplic,nbSimulations,seed,nbThreads,NULL,nbTasks,param_device==deviceCUDA ? nbSimulations : param_batch};
+  trialContext *contexts;
+  poolWorker workers[nbThreads];
+  pthread_t threads[nbThreads];
+  jobResults *jobs;
+  if (posix_memalign((void **)&queue.ranges,arenaAlignment,nbThreads*sizeof(workerRange)))
+    error("Cannot allocate the trial contexts.","");
+  if (nbWarmContexts>=nbThreads)
+    contexts=warmContexts;
+  else {
+    releaseWarmContexts();
+    if (posix_memalign((void **)&contexts,arenaAlignment,nbThreads*sizeof(trialContext)))
+      error("Cannot allocate the trial contexts.","");
+    memset(contexts,0,nbThreads*sizeof(trialContext));
+    for(w=0;w<nbThreads;w++)
+      allocateTrialContext(&contexts[w]);
+  }
+  for(w=0;w<nbThreads;w++) {
+    workers[w]=(poolWorker){w,&contexts[w],&queue,NULL,0,0,-1,0};
+    atomic_init(&queue.ranges[w].range,packRange(nbTasks*w/nbThreads,nbTasks*(w+1)/nbThreads));
+  }
+  if (nbThreads==1)
+    runJobs(&workers[0]);
+  else {
+    for(w=0;w<nbThreads;w++)
+      if (pthread_create(&threads[w],NULL,runJobs,&workers[w]))
+	error("Cannot create worker thread.","");
+    for(w=0;w<nbThreads;w++)
+      pthread_join(threads[w],NULL);
+  }
+  // Merge the recalls of the jobs, in the order of the tasks
+  for(w=0;w<nbThreads;w++)
+    nbJobs+=workers[w].nbJobs;
+  if ((jobs=malloc(nbJobs*sizeof(jobResults)+1))==NULL)
+    error("Cannot allocate the jobs.","");
+  for(nbJobs=0,w=0;w<nbThreads;w++) {
+    memcpy(jobs+nbJobs,workers[w].jobs,workers[w].nbJobs*sizeof(jobResults));
+    nbJobs+=workers[w].nbJobs;
+    free(workers[w].jobs);
+  }
+  qsort(jobs,nbJobs,sizeof(jobResults),compareJobs);
+  if (trialsFile) {
+    for(w=0;w<nbThreads;w++)
+      if (contexts[w].results.spill)
+	flushWriter(&contexts[w].results);
+    for(j=0;j<nbJobs;j++)
+      copyWriterPart(&contexts[jobs[j].worker].results,jobs[j].offset,jobs[j].length,trialsFile);
+    fflush(trialsFile);
+  }
+  if (eventsFile) {
+    for(w=0;w<nbThreads;w++)
+      if (contexts[w].eventLog.spill)
+	flushWriter(&contexts[w].eventLog);
+    for(j=0;j<nbJobs;j++)
+      copyWriterPart(&contexts[jobs[j].worker].eventLog,jobs[j].eventOffset,jobs[j].eventLength,eventsFile);
+    fflush(eventsFile);
+  }
+  if (keepWarmContexts && contexts!=warmContexts) {
+    warmContexts=contexts;
+    nbWarmContexts=nbThreads;
+  }
+  else if (!keepWarmContexts) {
+    for(w=0;w<nbThreads;w++)
+      freeTrialContext(&contexts[w]);
+    free(contexts);
+  }
+  free(queue.ranges);
+  free(jobs);
+}
+
+float *continuousParameter(modelParameters *p,char *name) {
+  // Address of the continuous model parameter of given name (see setParameter), NULL if there is none
+  if (!strcmp(name,"memoDistr")) return(&p->memoDistr);
+  else if (!strcmp(name,"R")) return(&p->R);
+  else if (!strcmp(name,"P")) return(&p->P);
+  else if (!strcmp(name,"s")) return(&p->s);
+  else if (!strcmp(name,"D")) return(&p->D);
+  else if (!strcmp(name,"theta")) return(&p->theta);
+  else if (!strcmp(name,"sigma")) return(&p->sigma);
+  else if (!strcmp(name,"Tr")) return(&p->Tr);
+  else if (!strcmp(name,"Ta")) return(&p->Ta);
+  else if (!strcmp(name,"freeTime")) return(&p->freeTime);
+  else if (!strcmp(name,"idn")) return(&p->itemDistractorNoise);
+  else if (!strcmp(name,"iio")) return(&p->itemItemOverlap);
+  else if (!strcmp(name,"ido")) return(&p->itemDistractorOverlap);
+  else if (!strcmp(name,"dw")) return(&p->distractorWeight);
+  return(NULL);
+}
+
+int setParameter(modelParameters *p,char *name,char *value) {
+  // Set the model parameter of given name (as on the command line). Return 0 if there is no such parameter
+  if (!strcmp(name,"nbmemo")) p->nbmemo=atoi(value);
+  else if (!strcmp(name,"memoDistr")) p->memoDistr=atof(value);
+  else if (!strcmp(name,"nbop")) p->nbop=atoi(value);
+  else if (!strcmp(name,"R")) p->R=atof(value);
+  else if (!strcmp(name,"P")) p->P=atof(value);
+  else if (!strcmp(name,"s")) p->s=atof(value);
+  else if (!strcmp(name,"D")) p->D=atof(value);
+  else if (!strcmp(name,"theta")) p->theta=atof(value);
+  else if (!strcmp(name,"sigma")) p->sigma=atof(value);
+  else if (!strcmp(name,"Tr")) p->Tr=atof(value);
+  else if (!strcmp(name,"Ta")) p->Ta=atof(value);
+  else if (!strcmp(name,"freeTime")) p->freeTime=atof(value);
+  else if (!strcmp(name,"ftiod")) p->freeTimeIncludesOpDuration=atoi(value);
+  else if (!strcmp(name,"sameDist")) p->sameDist=atoi(value);
+  else if (!strcmp(name,"idn")) p->itemDistractorNoise=atof(value);
+  else if (!strcmp(name,"iio")) p->itemItemOverlap=atof(value);
+  else if (!strcmp(name,"ido")) p->itemDistractorOverlap=atof(value);
+  else if (!strcmp(name,"dw")) p->distractorWeight=atof(value);
+  else
+    return(0);
+  return(1);
+}
+
+// Sweep specification: the points are the product of the rows of a points file (or the command
+// line parameters if there is none) and of the values of each grid parameter
+#define maxGridParameters 16
+#define maxGridValues 1024
+int nbGridParameters=0;
+char *gridNames[maxGridParameters];
+char *gridValues[maxGridParameters];     // "v1,v2,..." or "first:last:step"
+char *pointsFileName=NULL;
+int param_shard=1;                       // shard <i/N>: range i of the N ranges of the points
+int param_nbShards=1;
+
+int expandValues(char *spec,char values[][32]) {
+  // Expand a list or a range of values into strings. Return the number of values
+  int nb=0;
+  double first,last,step,v;
+  if (sscanf(spec,"%lf:%lf:%lf",&first,&last,&step)==3 && strchr(spec,':')) {
+    if (step<=0)
+      error("The step of a range should be positive: ",spec);
+    for(v=first;v<=last+step*1e-6;v=first+nb*step) {
+      if (nb==maxGridValues)
+	error("Too many values for a grid parameter: ",spec);
+      snprintf(values[nb++],32,"%g",v);
+    }
+  }
+  else {
+    char copy[strlen(spec)+1];
+    char *token=strtok(strcpy(copy,spec),",");
+    for(;token!=NULL;token=strtok(NULL,",")) {
+      if (nb==maxGridValues)
+	error("Too many values for a grid parameter: ",spec);
+      snprintf(values[nb++],32,"%s",token);
+    }
+  }
+  if (nb==0)
+    error("Cannot read the values of a grid parameter: ",spec);
+  return(nb);
+}
+
+int readPointsFile(char *fileName,modelParameters **rows) {
+  // Read a points file: a first line with parameter names, then one point per line.
+  // Parameters not in the file have their command line values. Return the number of points
+  FILE *file=fopen(fileName,"r");
+  char line[4096];
+  char *names[64];
+  int nbNames=0,nbRows=0,maxRows=0,c;
+  char *token;
+  if (file==NULL)
+    error("Cannot open the points file: ",fileName);
+  if (fgets(line,sizeof(line),file)==NULL)
+    error("Empty points file: ",fileName);
+  for(token=strtok(line," \t\r\n");token!=NULL && nbNames<64;token=strtok(NULL," \t\r\n"))
+    names[nbNames++]=strdup(token);
+  *rows=NULL;
+  while (fgets(line,sizeof(line),file)!=NULL) {
+    token=strtok(line," \t\r\n");
+    if (token==NULL || token[0]=='#')  // blank line or comment
+      continue;
+    if (nbRows==maxRows) {
+      maxRows=2*maxRows+16;
+      *rows=realloc(*rows,maxRows*sizeof(modelParameters));
+      if (*rows==NULL)
+	error("Cannot allocate the parameter points.","");
+    }
+    (*rows)[nbRows]=param;
+    for(c=0;c<nbNames;c++,token=strtok(NULL," \t\r\n")) {
+      if (token==NULL)
+	error("Missing value in the points file: ",names[c]);
+      if (!setParameter(&(*rows)[nbRows],names[c],token))
+	error("Unknown parameter in the points file: ",names[c]);
+    }
+    nbRows++;
+  }
+  fclose(file);
+  for(c=0;c<nbNames;c++)
+    free(names[c]);
+  return(nbRows);
+}
+
+int createSweepPoints(parameterPoint **points) {
+  // Create the points of the sweep. Return their number
+  modelParameters *rows;
+  int nbRows=1,nbPoints,g,n,index;
+  int nbValues[maxGridParameters];
+  char (*values[maxGridParameters])[32];
+  if (pointsFileName)
+    nbRows=readPointsFile(pointsFileName,&rows);
+  else {
+    rows=malloc(sizeof(modelParameters));
+    rows[0]=param;
+  }
+  nbPoints=nbRows;
+  for(g=0;g<nbGridParameters;g++) {
+    values[g]=malloc(maxGridValues*32);
+    nbValues[g]=expandValues(gridValues[g],values[g]);
+    nbPoints*=nbValues[g];
+  }
+  if (nbPoints<1)
+    error("The sweep has no points.","");
+  *points=malloc(nbPoints*sizeof(parameterPoint));
+  if (*points==NULL)
+    error("Cannot allocate the parameter points.","");
+  for(n=0;n<nbPoints;n++) {  // the last grid parameter varies fastest
+    modelParameters p=rows[n/(nbPoints/nbRows)];
+    index=n%(nbPoints/nbRows);
+    for(g=nbGridParameters-1;g>=0;g--) {
+      if (!setParameter(&p,gridNames[g],values[g][index%nbValues[g]]))
+	error("Unknown grid parameter: ",gridNames[g]);
+      index/=nbValues[g];
+    }
+    initializePoint(&(*points)[n],&p);
+  }
+  for(g=0;g<nbGridParameters;g++)
+    free(values[g]);
+  free(rows);
+  return(nbPoints);
+}
+
+void writePointResults(parameterPoint *point,int nbSimulations) {
+  // Line of the points file. span is the mean number of items recalled at their position
+  modelParameters *p=&point->param;
+  int i;
+  if (pointsFile==NULL)
+    return;
+  fprintf(pointsFile,"%d,%d,%d,%d,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%d,%d,%d,%g,%g,%d,%g,%g,",++nbPointsWritten,nbSimulations,p->nbmemo,p->nbop,p->P,p->R,p->s,p->tauE,p->L,p->theta,p->sigma,p->D,p->Tr,p->tauOp,p->Ta,p->freeTime,p->freeTimeIncludesOpDuration,p->refreshLastStopped,p->attentionalFocusSize,p->itemDistractorOverlap,p->itemDistractorNoise,p->sameDist,(double)point->nbCorrect/p->nbmemo/nbSimulations,(double)point->nbCorrect/nbSimulations);
+  for(i=1;i<=p->nbmemo;i++)
+    fprintf(pointsFile,"%s%g",i>1 ? ";" : "",(double)point->serialPositionCount[i]/nbSimulations);
+  fprintf(pointsFile,"\n");
+}
+
+void printPointData(parameterPoint *point,int nbSimulations,int nbmemo) {
+  // Data line of the results of a point (see the headings of main)
+  modelParameters *p=&point->param;
+  printf("%d %d %d %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %1.3f %d %d %d ",nbSimulations,nbmemo,p->nbop,(float)point->nbCorrect/p->nbmemo/nbSimulations,p->P,p->R,p->s,p->tauE,p->L,p->theta,p->sigma,p->D,p->Tr,p->tauOp,p->Ta,p->freeTime,p->freeTimeIncludesOpDuration,p->refreshLastStopped,p->attentionalFocusSize);
+}
+
+void printPointProfile(parameterPoint *point) {
+  // Profile line of a point (profile 1): calls and microseconds of each phase per trial, then
+  // the counted events
+  profileCounts counts;
+  uint64_t *words=(uint64_t *)&counts;
+  double trials,secondsPerTick=1/ticksPerSecond();
+  int k;
+  if (!param_profile)
+    return;
+  for(k=0;k<profileWords;k++)
+    words[k]=point->profile[k];
+  if (counts.trials==0)
+    return;
+  trials=counts.trials;
+  printf("Profile %llu trials, per trial:",(unsigned long long)counts.trials);
+  for(k=0;k<nbProfilePhases;k++)
+    printf(" %s %.1f %.1fus",profilePhaseNames[k],counts.calls[k]/trials,counts.ticks[k]*secondsPerTick*1e6/trials);
+  printf(", retrievals below theta %.1f%%, distractor patterns %.1f, nearest lookups %.1f\n",
+	 counts.calls[profileRetrieve] ? 100.*counts.counters[profileFailedRetrievals]/counts.calls[profileRetrieve] : 0,
+	 counts.counters[profileDistractorPatterns]/trials,counts.counters[profileNearestLookups]/trials);
+}
+
+
+/**************/
+/* CHECKPOINT */
+/**************/
+// A checkpoint file holds the results of the points of a shard after a number of replications
+// (the same for all of them): a header, then for each point its parameters, its number of
+// correct recalls and its serial position counts. Replication n+1 of a point starts from the
+// seed stream jumped n times, so the seed and n are all a run needs to go on. The file is
+// written next to the checkpoint and renamed, so a crash leaves the previous checkpoint
+#define checkpointMagic "TBRSCKP2"
+#define checkpointHeaderSize 56
+char *checkpointFileName=NULL;           // checkpoint <file>
+double param_checkpointInterval=60;      // checkpointInterval <seconds>
+
+typedef struct {
+  char magic[8];
+  uint64_t seed;
+  uint64_t configuration;                // hash of the settings of the engine (engineConfiguration)
+  int32_t nbSimulations;
+  int32_t nbPoints;                      // points of the whole sweep
+  int32_t shard;
+  int32_t nbShards;
+  int32_t first;                         // index of the first point of the shard in the sweep (from 0)
+  int32_t count;                         // points of the shard
+  int32_t done;                          // replications of each point done
+  int32_t nbFields;                      // parameters of each point
+} checkpointHeader;
+
+// The parameters of a point are written field by field, as little-endian 32-bit words (the
+// model variables are computed again by prepareParameters), and the counts as 64-bit words
+_Static_assert(sizeof(int)==4 && sizeof(float)==4,"the checkpoint fields are 32-bit words");
+const size_t checkpointFields[]={
+  offsetof(modelParameters,P),offsetof(modelParameters,R),offsetof(modelParameters,s),
+  offsetof(modelParameters,tauE),offsetof(modelParameters,L),offsetof(modelParameters,theta),
+  offsetof(modelParameters,sigma),offsetof(modelParameters,D),offsetof(modelParameters,Tr),
+  offsetof(modelParameters,tauOp),offsetof(modelParameters,Ta),offsetof(modelParameters,freeTime),
+  offsetof(modelParameters,freeTimeIncludesOpDuration),offsetof(modelParameters,refreshLastStopped),
+  offsetof(modelParameters,attentionalFocusSize),offsetof(modelParameters,nbmemo),
+  offsetof(modelParameters,memoDistr),offsetof(modelParameters,nbop),
+  offsetof(modelParameters,presentationTime),offsetof(modelParameters,itemDistractorOverlap),
+  offsetof(modelParameters,itemDistractorNoise),offsetof(modelParameters,itemItemOverlap),
+  offsetof(modelParameters,sameDist),offsetof(modelParameters,distractorWeight)};
+#define nbCheckpointFields ((int)(sizeof(checkpointFields)/sizeof(checkpointFields[0])))
+
+uint32_t parameterField(const modelParameters *p,int k) {
+  uint32_t value;
+  memcpy(&value,(const char *)p+checkpointFields[k],4);
+  return(value);
+}
+
+int sameParameters(const modelParameters *p1,const modelParameters *p2) {
+  // Whether two points have the same parameters (the fields of a checkpoint)
+  int k;
+  for(k=0;k<nbCheckpointFields;k++)
+    if (parameterField(p1,k)!=parameterField(p2,k))
+      return(0);
+  return(1);
+}
+
+uint64_t hashWord(uint64_t hash,uint32_t word) {
+  // FNV-1a of the bytes of a little-endian 32-bit word
+  int i;
+  for(i=0;i<4;i++,word>>=8)
+    hash=(hash^(word&255))*1099511628211ULL;
+  return(hash);
+}
+
+uint64_t hashFloat(uint64_t hash,float value) {
+  uint32_t word;
+  memcpy(&word,&value,4);
+  return(hashWord(hash,word));
+}
+
+uint64_t engineConfiguration(void) {
+  // Hash of the settings that change the results of a point besides its parameters: dimensions,
+  // memoranda, interference and processing models, closest LTM item search, fast math, device
+  uint64_t hash=14695981039346656037ULL;
+  int i,j;
+  int settings[]={nbItemUnits,PRESET,maxMemoranda,maxDistractors,maxPosition,param_interference,
+    param_processing,param_nearest,param_precision,param_fastMath,param_drawMemoranda,param_device,
+    param_designLength,memorandaPoolSize,
+    param_nearest==nearestPrefix ? param_prefixDims : 0,param_nearest==nearestPrefix ? param_shortlist : 0};
+  for(i=0;i<(int)(sizeof(settings)/sizeof(settings[0]));i++)
+    hash=hashWord(hash,settings[i]);
+  hash=hashFloat(hash,param_interference==interferenceMemoranda ? param_interferenceWeight : 0);
+  for(i=0;i<param_designLength;i++)
+    hash=hashWord(hash,param_design[i]);
+  for(i=0;PRESET==itemsEmbeddings && i<memorandaPoolSize;i++) {  // the values of the memoranda
+    const float *embedding=embeddingRow(&embeddings,memorandaPool[i]);
+    for(j=0;j<nbItemUnits;j++)
+      hash=hashFloat(hash,embedding[j]);
+  }
+  return(hash);
+}
+
+void shardRange(int nbPoints,int *first,int *count) {
+  // Points of the shard of the run
+  *first=(long)nbPoints*(param_shard-1)/param_nbShards;
+  *count=(long)nbPoints*param_shard/param_nbShards-*first;
+}
+
+void writeCheckpoint(checkpointHeader *header,parameterPoint points[]) {
+  char fileName[strlen(checkpointFileName)+8];
+  unsigned char bytes[checkpointHeaderSize+4*nbCheckpointFields+8*(maxPosition+1)];
+  FILE *file;
+  int p,i,k,size;
+  sprintf(fileName,"%s.tmp",checkpointFileName);
+  if ((file=fopen(fileName,"wb"))==NULL)
+    error("Cannot create the checkpoint file: ",fileName);
+  memcpy(bytes,header->magic,8);
+  writeUint64LE(bytes+8,header->seed);
+  writeUint64LE(bytes+16,header->configuration);
+  writeUint32LE(bytes+24,header->nbSimulations);
+  writeUint32LE(bytes+28,header->nbPoints);
+  writeUint32LE(bytes+32,header->shard);
+  writeUint32LE(bytes+36,header->nbShards);
+  writeUint32LE(bytes+40,header->first);
+  writeUint32LE(bytes+44,header->count);
+  writeUint32LE(bytes+48,header->done);
+  writeUint32LE(bytes+52,header->nbFields);
+  fwrite(bytes,checkpointHeaderSize,1,file);
+  for(p=0;p<header->count;p++) {
+    for(k=0;k<nbCheckpointFields;k++)
+      writeUint32LE(bytes+4*k,parameterField(&points[p].param,k));
+    size=4*nbCheckpointFields;
+    writeUint64LE(bytes+size,points[p].nbCorrect);
+    for(i=1;i<=points[p].param.nbmemo;i++)
+      writeUint64LE(bytes+size+8*i,points[p].serialPositionCount[i]);
+    fwrite(bytes,size+8*(points[p].param.nbmemo+1),1,file);
+  }
+  if (fclose(file) || rename(fileName,checkpointFileName))
+    error("Cannot write the checkpoint file: ",checkpointFileName);
+}
+
+parameterPoint *readCheckpoint(char *fileName,checkpointHeader *header) {
+  // Read a checkpoint file. Return its points (with their parameters and results, no schedule),
+  // or NULL if the file does not exist
+  FILE *file=fopen(fileName,"rb");
+  unsigned char bytes[checkpointHeaderSize+4*nbCheckpointFields+8];
+  parameterPoint *points;
+  int p,i,k;
+  uint32_t value;
+  if (file==NULL)
+    return(NULL);
+  if (fread(bytes,checkpointHeaderSize,1,file)!=1 || memcmp(bytes,checkpointMagic,8))
+    error("Not a checkpoint file of this build: ",fileName);
+  memcpy(header->magic,bytes,8);
+  header->seed=readUint64LE(bytes+8);
+  header->configuration=readUint64LE(bytes+16);
+  header->nbSimulations=readUint32LE(bytes+24);
+  header->nbPoints=readUint32LE(bytes+28);
+  header->shard=readUint32LE(bytes+32);
+  header->nbShards=readUint32LE(bytes+36);
+  header->first=readUint32LE(bytes+40);
+  header->count=readUint32LE(bytes+44);
+  header->done=readUint32LE(bytes+48);
+  header->nbFields=readUint32LE(bytes+52);
+  if (header->nbFields!=nbCheckpointFields || header->count<0)
+    error("Not a checkpoint file of this build: ",fileName);
+  if ((points=calloc(header->count+1,sizeof(parameterPoint)))==NULL)
+    error("Cannot allocate the parameter points.","");
+  for(p=0;p<header->count;p++) {
+    if (fread(bytes,4*nbCheckpointFields+8,1,file)!=1)
+      error("Truncated checkpoint file: ",fileName);
+    for(k=0;k<nbCheckpointFields;k++) {
+      value=readUint32LE(bytes+4*k);
+      memcpy((char *)&points[p].param+checkpointFields[k],&value,4);
+    }
+    points[p].nbCorrect=readUint64LE(bytes+4*nbCheckpointFields);
+    if (points[p].param.nbmemo<1 || points[p].param.nbmemo>maxPosition || (points[p].serialPositionCount=calloc(points[p].param.nbmemo+1,sizeof(_Atomic long)))==NULL)
+      error("Bad checkpoint file: ",fileName);
+    for(i=1;i<=points[p].param.nbmemo;i++) {
+      if (fread(bytes,8,1,file)!=1)
+	error("Truncated checkpoint file: ",fileName);
+      points[p].serialPositionCount[i]=readUint64LE(bytes);
+    }
+  }
+  fclose(file);
+  return(points);
+}
+
+void runCheckpointedPoints(parameterPoint points[],int first,int count,int nbPoints,int nbSimulations,uint64_t *seed) {
+  // Run the points of a shard by rounds of replications, saving a checkpoint after each round.
+  // If the checkpoint file exists, go on from it (it must be a checkpoint of the same run)
+  checkpointHeader header={checkpointMagic,*seed,engineConfiguration(),nbSimulations,nbPoints,param_shard,param_nbShards,first,count,0,nbCheckpointFields};
+  parameterPoint *saved=readCheckpoint(checkpointFileName,&header);
+  int p,i,round=max(1,nbSimulations/64);   // the first round measures the time of a replication
+  double start;
+  if (saved) {
+    if (header.nbSimulations!=nbSimulations || header.nbPoints!=nbPoints || header.shard!=param_shard || header.nbShards!=param_nbShards || (param_deterministic && header.seed!=param_deterministic))
+      error("The checkpoint is the one of another run: ",checkpointFileName);
+    if (header.configuration!=engineConfiguration())
+      error("The checkpoint was written with other settings of the engine (units, items, memoranda, interference, nearest...): ",checkpointFileName);
+    for(p=0;p<count;p++) {
+      if (!sameParameters(&saved[p].param,&points[p].param))
+	error("The checkpoint has other parameter points: ",checkpointFileName);
+      points[p].nbCorrect=saved[p].nbCorrect;
+      for(i=1;i<=points[p].param.nbmemo;i++)
+	points[p].serialPositionCount[i]=saved[p].serialPositionCount[i];
+      freePoint(&saved[p]);
+    }
+    free(saved);
+    *seed=header.seed;
+    printf("Going on from %d replications of each point (%s)\n",header.done,checkpointFileName);
+  }
+  while (header.done<nbSimulations) {
+    round=min(round,nbSimulations-header.done);
+    start=benchClock();
+    runPoints(points,count,header.done+1,round,header.seed);
+    header.done+=round;
+    writeCheckpoint(&header,points);
+    double perReplication=(benchClock()-start)/round;
+    round=perReplication*INT_MAX<param_checkpointInterval ? INT_MAX : max(1,param_checkpointInterval/perReplication);
+  }
+}
+
+void printSweepResults(parameterPoint points[],int first,int count,int nbSimulations) {
+  // One line of results per point (numbered in the whole sweep), also written in the points file
+  int p,i,maxNbmemo=0;
+  for(p=0;p<count;p++)
+    maxNbmemo=max(maxNbmemo,points[p].param.nbmemo);
+  printf("Point NBSimulations NbMemo NbOp ProportionCorrect P R s tauE L theta sigma D Tr tauOp Ta freeTime ftIncludesOp refreshLastStopped attentionalFocusSize ");
+  for(i=1;i<=maxNbmemo;i++)
+    printf("Pos%d ",i);
+  printf("\n");
+  nbPointsWritten=first;
+  for(p=0;p<count;p++) {
+    printf("%d ",first+p+1);
+    printPointData(&points[p],nbSimulations,points[p].param.nbmemo);
+    for(i=1;i<=points[p].param.nbmemo;i++)
+      printf("%1.4f ",(float)points[p].serialPositionCount[i]/nbSimulations);
+    printf("\n");
+    printPointProfile(&points[p]);
+    writePointResults(&points[p],nbSimulations);
+  }
+}
+
+void mergeCheckpoints(char *list) {
+  // Results of a sweep from the checkpoints of all its shards, which must be complete
+  char copy[strlen(list)+1];
+  char *fileName;
+  checkpointHeader header,reference={{0}};
+  parameterPoint *points=NULL,*shard;
+  int nbPoints=0,p,nbFound=0;
+  char *found=NULL;
+  for(fileName=strtok(strcpy(copy,list),",");fileName!=NULL;fileName=strtok(NULL,",")) {
+    if ((shard=readCheckpoint(fileName,&header))==NULL)
+      error("Cannot open the checkpoint file: ",fileName);
+    if (points==NULL) {
+      reference=header;
+      nbPoints=header.nbPoints;
+      points=calloc(nbPoints+1,sizeof(parameterPoint));
+      found=calloc(nbPoints+1,1);
+      if (points==NULL || found==NULL)
+	error("Cannot allocate the parameter points.","");
+    }
+    if (header.seed!=reference.seed || header.nbSimulations!=reference.nbSimulations || header.nbPoints!=nbPoints || header.nbShards!=reference.nbShards)
+      error("The checkpoint is not a shard of the same sweep: ",fileName);
+    if (header.configuration!=reference.configuration)
+      error("The shard was run with other settings of the engine than the first one: ",fileName);
+    if (header.done<header.nbSimulations)
+      error("The shard has not run all its replications: ",fileName);
+    for(p=0;p<header.count;p++) {
+      if (header.first+p>=nbPoints || found[header.first+p])
+	error("The checkpoint has points of another shard: ",fileName);
+      found[header.first+p]=1;
+      points[header.first+p]=shard[p];
+      nbFound++;
+    }
+    free(shard);
+  }
+  if (nbFound<nbPoints)
+    error("Shards are missing: not all the points of the sweep were found.","");
+  printSweepResults(points,0,nbPoints,reference.nbSimulations);
+  for(p=0;p<nbPoints;p++)
+    freePoint(&points[p]);
+  free(points);
+  free(found);
+}
+
+
+/*******/
+/* FIT */
+/*******/
+// fit <param>[:min:max],... searches the values of the parameters which minimize the RMSE between
+// the serial position curve of the model and target <p1,p2,...> (one proportion per position)
+// with a Nelder-Mead simplex. All the candidates are run with the same seed, so replication n of
+// every candidate draws the same random numbers (common random numbers): the RMSE is a
+// deterministic function of the parameters and close candidates are compared without independent
+// noise. A candidate that only has to beat a given RMSE (reflections, expansions, contractions)
+// is first run on nbSimulations/fitStages replications, and dropped if its RMSE exceeds the one to
+// beat by fitRejectZ sampling standard errors. The candidates are written in the points file
+#define maxFitParameters 16
+#define fitStages 4                    // the first stage of a candidate runs 1/fitStages of the replications
+#define fitRejectZ 3
+#define fitStep .2                     // relative size of the initial simplex (absolute if the value is 0)
+#define fitTolerance 1e-4              // the search stops when the RMSEs of the simplex differ by less
+int nbFitParameters=0;
+char *fitNames[maxFitParameters];
+float fitMin[maxFitParameters];
+float fitMax[maxFitParameters];
+float *fitTarget=NULL;                 // target <p1,p2,...>
+int fitTargetLength=0;
+int param_fitIterations=200;           // fitIterations <value>
+int nbFitEvaluations=0;
+
+typedef struct {
+  float values[maxFitParameters];
+  double rmse;
+  int nbSimulations;                   // replications the RMSE is computed on
+} fitCandidate;
+
+void parseFitParameters(char *list) {
+  // Read the fit option: names of continuous parameters, each one with optional bounds
+  char copy[strlen(list)+1];
+  char *token,*bound;
+  for(token=strtok(strcpy(copy,list),",");token!=NULL;token=strtok(NULL,",")) {
+    if (nbFitParameters==maxFitParameters)
+      error("Too many fit parameters.","");
+    if ((bound=strchr(token,':'))!=NULL)
+      *bound++='\0';
+    if (continuousParameter(&param,token)==NULL)
+      error("Unknown or not continuous fit parameter: ",token);
+    fitNames[nbFitParameters]=strdup(token);
+    fitMin[nbFitParameters]=0;         // the parameters of the model are not negative
+    fitMax[nbFitParameters]=HUGE_VALF;
+    if (bound!=NULL && sscanf(bound,"%f:%f",&fitMin[nbFitParameters],&fitMax[nbFitParameters])!=2)
+      error("Bad bounds of fit parameter (name:min:max): ",token);
+    if (fitMin[nbFitParameters]>fitMax[nbFitParameters])
+      error("Empty range of fit parameter: ",token);
+    nbFitParameters++;
+  }
+}
+
+void parseFitTarget(char *list) {
+  // Read the target serial position curve (p1,p2,...)
+  char *end=list;
+  fitTargetLength=0;
+  do {
+    fitTarget=realloc(fitTarget,sizeof(float)*(fitTargetLength+1));
+    if (fitTarget==NULL)
+      error("Cannot allocate the target.","");
+    fitTarget[fitTargetLength]=strtod(end,&end);
+    if (fitTarget[fitTargetLength]<0 || fitTarget[fitTargetLength++]>1 || (*end!=',' && *end!='\0'))
+      error("Bad target (proportions correct p1,p2,...): ",list);
+  } while (*end++==',');
+}
+
+float clampFitValue(int k,float value) {
+  return(value<fitMin[k] ? fitMin[k] : value>fitMax[k] ? fitMax[k] : value);
+}
+
+void initializeCandidatePoint(parameterPoint *point,fitCandidate *candidate) {
+  modelParameters p=param;
+  int k;
+  for(k=0;k<nbFitParameters;k++)
+    *continuousParameter(&p,fitNames[k])=candidate->values[k]=clampFitValue(k,candidate->values[k]);
+  initializePoint(point,&p);
+}
+
+double pointRMSE(parameterPoint *point,int nbSimulations,double *standardError) {
+  // RMSE between the serial position curve of a point and the target, and its sampling standard
+  // error (binomial variance of the proportions)
+  double sum=0,variance=0,proportion;
+  int i;
+  for(i=1;i<=fitTargetLength;i++) {
+    proportion=(double)point->serialPositionCount[i]/nbSimulations;
+    sum+=(proportion-fitTarget[i-1])*(proportion-fitTarget[i-1]);
+    variance+=proportion*(1-proportion)/nbSimulations;
+  }
+  *standardError=sqrt(variance/fitTargetLength);
+  return(sqrt(sum/fitTargetLength));
+}
+
+void printCandidate(fitCandidate *candidate,int nbSimulations) {
+  int k;
+  printf("%d:",++nbFitEvaluations);
+  for(k=0;k<nbFitParameters;k++)
+    printf(" %s=%g",fitNames[k],candidate->values[k]);
+  printf(" RMSE %1.5f",candidate->rmse);
+  if (candidate->nbSimulations<nbSimulations)
+    printf(" (dropped after %d replications)",candidate->nbSimulations);
+  printf("\n");
+}
+
+void evaluateCandidates(fitCandidate candidates[],int nbCandidates,int nbSimulations,uint64_t seed) {
+  // Run all the replications of several candidates at once
+  parameterPoint points[nbCandidates];
+  double standardError;
+  int c;
+  for(c=0;c<nbCandidates;c++)
+    initializeCandidatePoint(&points[c],&candidates[c]);
+  runPoints(points,nbCandidates,1,nbSimulations,seed);
+  for(c=0;c<nbCandidates;c++) {
+    candidates[c].rmse=pointRMSE(&points[c],nbSimulations,&standardError);
+    candidates[c].nbSimulations=nbSimulations;
+    printCandidate(&candidates[c],nbSimulations);
+    writePointResults(&points[c],nbSimulations);
+    freePoint(&points[c]);
+  }
+}
+
+double evaluateCandidate(fitCandidate *candidate,double toBeat,int nbSimulations,uint64_t seed) {
+  // Run a candidate which is of no use if its RMSE is not below toBeat, and return its RMSE.
+  // The replications of the first stage are not run again if the candidate goes on
+  parameterPoint point;
+  double standardError;
+  int first=nbSimulations/fitStages;
+  initializeCandidatePoint(&point,candidate);
+  if (fitStages>1 && first>0) {
+    runPoints(&point,1,1,first,seed);
+    candidate->rmse=pointRMSE(&point,first,&standardError);
+    candidate->nbSimulations=first;
+  }
+  if (first==0 || candidate->rmse-fitRejectZ*standardError<=toBeat) {
+    runPoints(&point,1,first+1,nbSimulations-first,seed);
+    candidate->rmse=pointRMSE(&point,nbSimulations,&standardError);
+    candidate->nbSimulations=nbSimulations;
+  }
+  printCandidate(candidate,nbSimulations);
+  writePointResults(&point,candidate->nbSimulations);
+  freePoint(&point);
+  return(candidate->rmse);
+}
+
+int compareCandidates(const void *candidate1,const void *candidate2) {
+  double rmse1=((const fitCandidate *)candidate1)->rmse,rmse2=((const fitCandidate *)candidate2)->rmse;
+  return((rmse1>rmse2)-(rmse1<rmse2));
+}
+
+void moveCandidate(fitCandidate *result,fitCandidate *centroid,fitCandidate *vertex,float coefficient) {
+  // result = centroid + coefficient*(vertex-centroid)
+  int k;
+  for(k=0;k<nbFitParameters;k++)
+    result->values[k]=clampFitValue(k,centroid->values[k]+coefficient*(vertex->values[k]-centroid->values[k]));
+}
+
+void fitParameters(int nbSimulations,uint64_t seed) {
+  // Nelder-Mead search from the command line values, then results of the best candidate
+  int n=nbFitParameters,iteration,k,v;
+  fitCandidate simplex[maxFitParameters+1],centroid,reflected,expanded,contracted;
+  parameterPoint best;
+  if (fitTargetLength!=param.nbmemo)
+    error("The target should have one proportion per item (nbmemo).","");
+  for(v=0;v<=n;v++) {                  // initial simplex: one step on each parameter
+    for(k=0;k<n;k++)
+      simplex[v].values[k]=clampFitValue(k,*continuousParameter(&param,fitNames[k]));
+    if (v>0) {
+      k=v-1;
+      float step=simplex[v].values[k]!=0 ? fitStep*simplex[v].values[k] : fitStep;
+      simplex[v].values[k]=simplex[v].values[k]+step<=fitMax[k] ? simplex[v].values[k]+step : clampFitValue(k,simplex[v].values[k]-step);
+    }
+  }
+  evaluateCandidates(simplex,n+1,nbSimulations,seed);
+  for(iteration=0;iteration<param_fitIterations;iteration++) {
+    qsort(simplex,n+1,sizeof(fitCandidate),compareCandidates);
+    if (simplex[n].rmse-simplex[0].rmse<fitTolerance)
+      break;
+    for(k=0;k<n;k++) {                 // centroid of all the vertices but the worst one
+      centroid.values[k]=0;
+      for(v=0;v<n;v++)
+	centroid.values[k]+=simplex[v].values[k]/n;
+    }
+    moveCandidate(&reflected,&centroid,&simplex[n],-1);
+    evaluateCandidate(&reflected,simplex[n-1].rmse,nbSimulations,seed);
+    if (reflected.rmse<simplex[0].rmse) {
+      moveCandidate(&expanded,&centroid,&simplex[n],-2);
+      evaluateCandidate(&expanded,reflected.rmse,nbSimulations,seed);
+      simplex[n]=expanded.rmse<reflected.rmse ? expanded : reflected;
+    }
+    else if (reflected.rmse<simplex[n-1].rmse)
+      simplex[n]=reflected;
+    else {                             // contraction, outside if the reflection was better than the worst vertex
+      int outside=reflected.rmse<simplex[n].rmse;
+      double toBeat=outside ? reflected.rmse : simplex[n].rmse;
+      moveCandidate(&contracted,&centroid,outside ? &reflected : &simplex[n],.5);
+      if (evaluateCandidate(&contracted,toBeat,nbSimulations,seed)<toBeat)
+	simplex[n]=contracted;
+      else {                           // shrink towards the best vertex
+	for(v=1;v<=n;v++)
+	  moveCandidate(&simplex[v],&simplex[0],&simplex[v],.5);
+	evaluateCandidates(simplex+1,n,nbSimulations,seed);
+      }
+    }
+  }
+  qsort(simplex,n+1,sizeof(fitCandidate),compareCandidates);
+  printf("Best after %d evaluations (%d iterations): RMSE %1.5f\n",nbFitEvaluations,iteration,simplex[0].rmse);
+  // Results of the best candidate (the same streams give the same results again)
+  initializeCandidatePoint(&best,&simplex[0]);
+  runPoints(&best,1,1,nbSimulations,seed);
+  printf("NBSimulations NbMemo NbOp ProportionCorrect P R s tauE L theta sigma D Tr tauOp Ta freeTime ftIncludesOp refreshLastStopped attentionalFocusSize ");
+  for(k=1;k<=param.nbmemo;k++)
+    printf("Pos%d ",k);
+  printf("\n");
+  printPointData(&best,nbSimulations,param.nbmemo);
+  for(k=1;k<=param.nbmemo;k++)
+    printf("%1.4f ",(float)best.serialPositionCount[k]/nbSimulations);
+  printf("\n");
+  printPointProfile(&best);
+  freePoint(&best);
+}
+
+
+/********/
+/* SPAN */
+/********/
+// The span is the sum over the list lengths 1..nbmemo of the proportion of items recalled at their
+// position. The lengths are the points of one run: replication n of every length draws the same
+// position representations (the items come from the embedding store), so the lengths differ only
+// by their lists. With spanStop, all the lengths first run nbSimulations/spanStages replications,
+// and a length whose proportion correct is within spanFloor of 0 or 1 (by spanZ standard errors)
+// stops there: its part of the span is known to spanFloor
+#define spanStages 4
+#define spanFloor .02
+#define spanZ 3
+int param_spanStop=1;                  // spanStop <0 or 1>
+
+int settledLength(parameterPoint *point,int nbSimulations) {
+  // Whether the proportion correct of a list length is at floor or ceiling
+  double proportion=(double)point->nbCorrect/point->param.nbmemo/nbSimulations;
+  double margin=spanZ*sqrt(proportion*(1-proportion)/nbSimulations);
+  return(proportion+margin<spanFloor || proportion-margin>1-spanFloor);
+}
+
+void estimateSpan(int nbSimulations,uint64_t seed) {
+  // Run the list lengths and display the results of each one, with the span summed so far
+  int nbLengths=param.nbmemo,k,i,nbLeft=0;
+  int first=param_spanStop ? nbSimulations/spanStages : 0;
+  parameterPoint lengths[nbLengths],*left[nbLengths];
+  int nbRun[nbLengths];
+  float span=0,propCorrect;
+  for(k=0;k<nbLengths;k++) {
+    modelParameters p=param;
+    p.nbmemo=k+1;
+    initializePoint(&lengths[k],&p);
+  }
+  if (first>0) {
+    runPoints(lengths,nbLengths,1,first,seed);
+    for(k=0;k<nbLengths;k++)
+      nbRun[k]=first;
+  }
+  // The other replications of the lengths left, gathered in one array of points (runPoints adds
+  // their results to those of the first stage)
+  parameterPoint rest[nbLengths];
+  for(k=0;k<nbLengths;k++)
+    if (first==0 || !settledLength(&lengths[k],first)) {
+      left[nbLeft]=&lengths[k];
+      rest[nbLeft++]=lengths[k];
+      nbRun[k]=nbSimulations;
+    }
+  if (nbLeft>0)
+    runPoints(rest,nbLeft,first+1,nbSimulations-first,seed);
+  for(k=0;k<nbLeft;k++)
+    *left[k]=rest[k];
+  for(k=0;k<nbLengths;k++) {
+    writePointResults(&lengths[k],nbRun[k]);
+    propCorrect=(float)lengths[k].nbCorrect/(k+1)/nbRun[k];
+    // Headings
+    printf("NBSimulations NbMemo NbOp ProportionCorrect P R s tauE L theta sigma D Tr tauOp Ta freeTime ftIncludesOp refreshLastStopped attentionalFocusSize ");
+    // Data
+    printf("\n");
+    printPointData(&lengths[k],nbRun[k],k+1);
+    printf("\n");
+    printPointProfile(&lengths[k]);
+    printf("Span \n");
+    for(i=1;i<=k+1;i++)
+      printf("Pos%d ",i);
+    printf("\n");
+    for(i=1;i<=k+1;i++)
+      printf("%1.4f ",(float)lengths[k].serialPositionCount[i]/nbRun[k]);
+    printf("\n");
+    span+=propCorrect;
+    printf("%1.4f\n",span);
+    freePoint(&lengths[k]);
+  }
+}
+
+
+/**************************/
+/* PRECISION VALIDATION */
+/**************************/
+// validate runs the point of the command line in fp32 and at the storage precision, with the same
+// random streams, and displays the results of both and their difference
+char *precisionNames[]={"fp32","bf16","fp16","int8"};
+
+void printValidationLine(char *name,parameterPoint *point,int nbSimulations) {
+  int i;
+  printf("%-6s %1.4f ",name,(float)point->nbCorrect/point->param.nbmemo/nbSimulations);
+  for(i=1;i<=point->param.nbmemo;i++)
+    printf(" %1.4f",(float)point->serialPositionCount[i]/nbSimulations);
+  printf("\n");
+}
+
+void validatePrecision(int nbSimulations,uint64_t seed) {
+  parameterPoint reference,reduced;
+  int precision=param_precision,i;
+  initializePoint(&reference,&param);
+  initializePoint(&reduced,&param);
+  param_precision=precisionFP32;
+  runPoints(&reference,1,1,nbSimulations,seed);
+  param_precision=precision;
+  runPoints(&reduced,1,1,nbSimulations,seed);
+  printf("VALIDATION of %s against fp32 (n=%d)\n",precisionNames[precision],nbSimulations);
+  printf("       ProportionCorrect ");
+  for(i=1;i<=param.nbmemo;i++)
+    printf("Pos%d   ",i);
+  printf("\n");
+  printValidationLine("fp32",&reference,nbSimulations);
+  printValidationLine(precisionNames[precision],&reduced,nbSimulations);
+  printf("change %+1.4f ",(float)(reduced.nbCorrect-reference.nbCorrect)/param.nbmemo/nbSimulations);
+  for(i=1;i<=param.nbmemo;i++)
+    printf(" %+1.4f",(float)(reduced.serialPositionCount[i]-reference.serialPositionCount[i])/nbSimulations);
+  printf("\n");
+  writePointResults(&reference,nbSimulations);
+  writePointResults(&reduced,nbSimulations);
+  freePoint(&reference);
+  freePoint(&reduced);
+}
+
+
+/**********/
+/* SERVER */
+/**********/
+// serve <-|path> keeps the process, its embeddings and the contexts of its workers from a query
+// to the next. It reads requests from stdin (serve -) or from the clients of a Unix socket, and
+// writes the response to each request to its client. All numbers are little-endian.
+// Request:  "TBRQ", uint32 id, uint32 nbSimulations, uint64 seed (0: drawn by the server),
+//           uint32 nbParameters, then for each parameter a uint8 length, its name and a float64
+//           value (parameters of setParameter, the other ones keep their command line values)
+// Response: "TBRP", uint32 id, uint32 status. Status 0: uint32 nbSimulations, uint32 nbmemo,
+//           uint64 seed, uint64 nbCorrect and nbmemo uint64 (correct recalls at each position).
+//           Status 1: uint32 length and the error message
+// The requests read in one round (the data available on all the inputs) are run together: those
+// with the same number of replications and seed are the points of one run of the pool (see
+// SWEEP), so that small requests of several clients keep all the workers busy. A request with
+// seed s gives the results of determ s for its point
+#define requestMagic "TBRQ"
+#define responseMagic "TBRP"
+#define requestHeaderSize 24
+#define maxRequestParameters 64
+#define serverBufferSize 65536      // bytes read from a client at once, and largest request
+#define maxServerClients 64
+#define maxBatchRequests 4096       // requests run in one round, the others wait for the next one
+#define serverMessageSize 320       // longest error message of a response
+char *serverAddress=NULL;           // serve <-|path>
+
+typedef struct {
+  int in,out;              // descriptors (the same socket, or stdin and stdout)
+  int ended;               // end of input or failed output: closed after the round
+  int backlog;             // requests left in the buffer by a full round
+  unsigned char *buffer;   // bytes received and not parsed yet
+  size_t size;
+} serverClient;
+
+typedef struct {
+  int client;
+  uint32_t id;
+  uint32_t nbSimulations;
+  uint64_t seed;
+  int order;               // arrival in the round
+  modelParameters param;
+} serverRequest;
+
+void sendToClient(serverClient *client,const unsigned char *bytes,size_t size) {
+  // Write a response. A client whose output fails is closed after the round
+  ssize_t n;
+  if (client->out<0)
+    return;
+  while (size>0) {
+    if ((n=write(client->out,bytes,size))<=0) {
+      client->ended=1;
+      client->out=-1;
+      return;
+    }
+    bytes+=n;
+    size-=n;
+  }
+}
+
+void sendError(serverClient *client,uint32_t id,const char *message) {
+  size_t length=strlen(message);
+  unsigned char bytes[16+length];
+  memcpy(bytes,responseMagic,4);
+  writeUint32LE(bytes+4,id);
+  writeUint32LE(bytes+8,1);
+  writeUint32LE(bytes+12,length);
+  memcpy(bytes+16,message,length);
+  sendToClient(client,bytes,16+length);
+}
+
+void sendResults(serverClient *client,serverRequest *request,parameterPoint *point,uint64_t seed) {
+  int i,nbmemo=point->param.nbmemo;
+  unsigned char bytes[36+8*nbmemo];
+  memcpy(bytes,responseMagic,4);
+  writeUint32LE(bytes+4,request->id);
+  writeUint32LE(bytes+8,0);
+  writeUint32LE(bytes+12,request->nbSimulations);
+  writeUint32LE(bytes+16,nbmemo);
+  writeUint64LE(bytes+20,seed);
+  writeUint64LE(bytes+28,point->nbCorrect);
+  for(i=1;i<=nbmemo;i++)
+    writeUint64LE(bytes+28+8*i,point->serialPositionCount[i]);
+  sendToClient(client,bytes,36+8*nbmemo);
+}
+
+char *requestError(modelParameters *p) {
+  // parameterError(), and the checks of the run which would end the server
+  int i,nbDistractors=0;
+  char *message=parameterError(p);
+  if (message)
+    return(message);
+  for(i=1;i<=p->nbmemo;i++)
+    nbDistractors+=operationsAfterItem(p,i);
+  if (p->sameDist==0 && nbDistractors>maxDistractors)
+    return("Not enough distractors for the stimulus. Increase it with distractors <value>");
+  return(NULL);
+}
+
+long parseRequest(serverClient *client,long offset,serverRequest *request,char *message) {
+  // Parse the request at offset in the buffer of a client. Return its size, 0 if it is not
+  // complete, -1 if the buffer does not hold a request. message is set if the request is invalid
+  const unsigned char *bytes=client->buffer+offset;
+  long size=client->size-offset,end=requestHeaderSize;
+  int k,nbParameters,length;
+  char name[256],value[32],*invalid;
+  if (size<requestHeaderSize)
+    return(0);
+  if (memcmp(bytes,requestMagic,4))
+    return(-1);
+  request->id=readUint32LE(bytes+4);
+  request->nbSimulations=readUint32LE(bytes+8);
+  request->seed=readUint64LE(bytes+12);
+  nbParameters=readUint32LE(bytes+20);
+  if (nbParameters>maxRequestParameters)
+    return(-1);
+  request->param=param;
+  *message=0;
+  for(k=0;k<nbParameters;k++) {
+    if (end+1>size || end+1+bytes[end]+8>size)
+      return(0);
+    length=bytes[end];
+    memcpy(name,bytes+end+1,length);
+    name[length]=0;
+    uint64_t word=readUint64LE(bytes+end+1+length);
+    double number;
+    memcpy(&number,&word,sizeof(number));
+    snprintf(value,sizeof(value),"%.17g",number);
+    if (!*message && !setParameter(&request->param,name,value))
+      snprintf(message,serverMessageSize,"Unknown parameter: %s",name);
+    end+=1+length+8;
+  }
+  if (!*message && (request->nbSimulations<1 || request->nbSimulations>INT_MAX))
+    strcpy(message,"The number of replications should be between 1 and 2^31-1.");
+  if (!*message && (invalid=requestError(&request->param)))
+    strcpy(message,invalid);
+  return(end);
+}
+
+int takeRequests(serverClient clients[],int c,serverRequest requests[],int nbRequests) {
+  // Move the complete requests of the buffer of a client to the requests of the round (the invalid
+  // ones are answered at once). Return the number of requests of the round
+  serverClient *client=&clients[c];
+  long offset=0,size;
+  char message[serverMessageSize];
+  client->backlog=0;
+  while (1) {
+    serverRequest *request=&requests[nbRequests];
+    if (nbRequests==maxBatchRequests) {  // the other requests wait for the next round
+      client->backlog=1;
+      break;
+    }
+    if ((size=parseRequest(client,offset,request,message))==0)
+      break;
+    if (size<0) {
+      sendError(client,0,"Not a request of this server, or a request too large.");
+      client->ended=1;
+      offset=client->size;
+      break;
+    }
+    offset+=size;
+    if (*message)
+      sendError(client,request->id,message);
+    else {
+      request->client=c;
+      request->order=nbRequests++;
+    }
+  }
+  memmove(client->buffer,client->buffer+offset,client->size-offset);
+  client->size-=offset;
+  return(nbRequests);
+}
+
+int compareRequests(const void *request1,const void *request2) {
+  const serverRequest *r1=request1,*r2=request2;
+  if (r1->nbSimulations!=r2->nbSimulations)
+    return(r1->nbSimulations<r2->nbSimulations ? -1 : 1);
+  if (r1->seed!=r2->seed)
+    return(r1->seed<r2->seed ? -1 : 1);
+  return(r1->order-r2->order);
+}
+
+void runRequests(serverClient clients[],serverRequest requests[],int nbRequests,uint64_t roundSeed) {
+  // Run the requests of a round, one run of the pool for each number of replications and seed
+  // (split if it has too many tasks), and answer them
+  int first,n,k;
+  for(k=0;k<nbRequests;k++)
+    if (requests[k].seed==0)
+      requests[k].seed=roundSeed;
+  qsort(requests,nbRequests,sizeof(serverRequest),compareRequests);
+  for(first=0;first<nbRequests;first+=n) {
+    uint32_t nbSimulations=requests[first].nbSimulations;
+    uint64_t seed=requests[first].seed;
+    for(n=1;first+n<nbRequests && requests[first+n].nbSimulations==nbSimulations && requests[first+n].seed==seed && (long)(n+1)*nbSimulations<=INT_MAX;n++)
+      ;
+    parameterPoint points[n];
+    for(k=0;k<n;k++)
+      initializePoint(&points[k],&requests[first+k].param);
+    runPoints(points,n,1,nbSimulations,seed);
+    for(k=0;k<n;k++) {
+      sendResults(&clients[requests[first+k].client],&requests[first+k],&points[k],seed);
+      freePoint(&points[k]);
+    }
+  }
+}
+
+int openServerSocket(char *path) {
+  // Listening Unix socket at path (a socket left by a previous server is replaced)
+  struct sockaddr_un address;
+  struct stat status;
+  int listener;
+  if (strlen(path)>=sizeof(address.sun_path))
+    error("The path of the socket is too long:",path);
+  if (stat(path,&status)==0 && S_ISSOCK(status.st_mode))
+    unlink(path);
+  memset(&address,0,sizeof(address));
+  address.sun_family=AF_UNIX;
+  strcpy(address.sun_path,path);
+  if ((listener=socket(AF_UNIX,SOCK_STREAM,0))<0 || bind(listener,(struct sockaddr *)&address,sizeof(address)) || listen(listener,maxServerClients))
+    error("Cannot listen on the socket:",path);
+  return(listener);
+}
+
+void addClient(serverClient clients[],int *nbClients,int in,int out) {
+  if ((clients[*nbClients].buffer=malloc(serverBufferSize))==NULL)
+    error("Cannot allocate the buffer of a client.","");
+  clients[*nbClients].in=in;
+  clients[*nbClients].out=out;
+  clients[*nbClients].ended=0;
+  clients[*nbClients].backlog=0;
+  clients[*nbClients].size=0;
+  (*nbClients)++;
+}
+
+void runServer(char *address) {
+  // Answer the requests until the end of stdin (serve -), or forever (socket)
+  serverClient clients[maxServerClients];
+  struct pollfd fds[maxServerClients+1];
+  serverRequest *requests=malloc(maxBatchRequests*sizeof(serverRequest));
+  int listener=-1,nbClients=0,nbRequests,c,k,backlog=0;
+  uint64_t nbRounds=0;
+  ssize_t n;
+  if (requests==NULL)
+    error("Cannot allocate the requests.","");
+  keepWarmContexts=1;
+  signal(SIGPIPE,SIG_IGN);   // a client which has gone is only closed
+  if (!strcmp(address,"-"))
+    addClient(clients,&nbClients,STDIN_FILENO,STDOUT_FILENO);
+  else
+    listener=openServerSocket(address);
+  while (nbClients>0 || listener>=0) {
+    for(c=0;c<nbClients;c++)
+      fds[c]=(struct pollfd){clients[c].in,POLLIN,0};
+    fds[nbClients]=(struct pollfd){listener,nbClients<maxServerClients ? POLLIN : 0,0};
+    if (poll(fds,nbClients+(listener>=0),backlog ? 0 : -1)<0)
+      continue;  // interrupted
+    nbRequests=0;
+    for(c=0;c<nbClients;c++) {
+      if ((fds[c].revents & (POLLIN|POLLHUP|POLLERR)) && clients[c].size<serverBufferSize) {
+	if ((n=read(clients[c].in,clients[c].buffer+clients[c].size,serverBufferSize-clients[c].size))<=0)
+	  clients[c].ended=1;
+	else
+	  clients[c].size+=n;
+      }
+      nbRequests=takeRequests(clients,c,requests,nbRequests);
+    }
+    if (listener>=0 && (fds[nbClients].revents & POLLIN) && (k=accept(listener,NULL,NULL))>=0)
+      addClient(clients,&nbClients,k,k);
+    if (nbRequests>0)
+      runRequests(clients,requests,nbRequests,param_deterministic ? param_deterministic : (uint64_t)time(0)+nbRounds++);
+    // Close the clients which have ended, and look for the requests left in the buffers
+    for(backlog=0,c=0,k=0;c<nbClients;c++) {
+      if (clients[c].ended && !clients[c].backlog) {
+	if (clients[c].in!=STDIN_FILENO)
+	  close(clients[c].in);
+	free(clients[c].buffer);
+	continue;
+      }
+      backlog|=clients[c].backlog;
+      clients[k++]=clients[c];
+    }
+    nbClients=k;
+  }
+  free(requests);
+  releaseWarmContexts();
+}
+
+
+/*************/
+/* BENCHMARK */
+/*************/
+// bench times the kernels and whole trials at several sizes with a fixed seed, then checks that
+// reference runs still give the same results. Item representations are random (items random), so no
+// embedding file is needed. Timings use the parameters of the command line, the reference runs
+// use the default parameters
+#define benchSeed 12345
+#define benchCalls 20000            // calls of each kernel at each size
+#define benchTrials 200             // trials timed at each size
+#define benchKernels 6
+#define benchMemoranda 10           // dimensions of the reference runs
+#define benchPositions 100
+#define timeCalls(ns,call) {double start=benchClock(); for(c=0;c<benchCalls;c++) call; ns=(benchClock()-start)*1e9/benchCalls;}
+
+typedef struct {
+  int nbItemUnits;
+  int maxDistractors;
+  int nbop;
+} benchSize;
+
+benchSize benchSizes[]={{100,90,4},{768,90,4},{100,90,12},{768,90,12},{256,250,16}};
+
+typedef struct {
+  int nbItemUnits;
+  int nbop;
+  int processing;                   // processing variant (param_processing)
+  int nbSimulations;
+  long nbCorrect;                   // expected results with the default parameters (nbmemo=7)
+  long serialPositionCount[8];
+} benchReference;
+
+benchReference benchReferences[]={
+  {100,4,processingNormal,500,1476,{0,468,355,266,176,114,45,52}},
+  {768,12,processingNormal,200,430,{0,171,106,82,42,25,4,0}},
+  {100,2,processingNormal,500,1987,{0,476,380,316,233,163,133,286}},
+  {100,4,processingAutopilot,500,1494,{0,464,358,273,185,118,41,55}}
+};
+
+char *benchKernelNames[benchKernels]={"retrieve","encode","decay","interfere","nearest","overlap"};
+volatile float benchSink;           // results of the kernels, so that their calls are not removed
+
+void setBenchDimensions(int units,int distractors) {
+  nbItemUnits=units;
+  itemStride=paddedSize(nbItemUnits);
+  maxDistractors=distractors;
+  maxItem=maxMemoranda+maxDistractors;
+}
+
+void benchSizeKernels(benchSize *size,modelParameters *p) {
+  // Time whole trials, then each kernel on the state left by the last trial
+  trialContext *ctx;
+  parameterPoint point;
+  modelParameters q=*p;
+  double ns[benchKernels],start,trialsPerSecond;
+  float activationMax,duration,distance,*scratch;
+  int c,k,bestWMItem;
+  setBenchDimensions(size->nbItemUnits,size->maxDistractors);
+  q.nbop=size->nbop;
+  initializePoint(&point,&q);
+  if (posix_memalign((void **)&ctx,arenaAlignment,sizeof(trialContext)) || posix_memalign((void **)&scratch,arenaAlignment,sizeof(float)*itemStride))
+    error("Cannot allocate the benchmark context.","");
+  memset(ctx,0,sizeof(trialContext));
+  memset(scratch,0,sizeof(float)*itemStride);
+  allocateTrialContext(ctx);
+  ctx->param=point.param;
+
+  start=benchClock();
+  runReplications(ctx,point.schedule,benchSeed,1,benchTrials);
+  trialsPerSecond=benchTrials/(benchClock()-start);
+
+  float (*itemVectorsInWM)[itemStride]=(void *)ctx->itemVectorsInWM;
+  float (*itemVectorsInLTM)[itemStride]=(void *)ctx->itemVectorsInLTM;
+  int nbmemo=q.nbmemo;
+  timeCalls(ns[0],benchSink+=retrieve(ctx,1+c%nbmemo,1,&activationMax,&duration,&bestWMItem));
+  timeCalls(ns[1],benchSink+=encode(ctx,0,1+c%nbmemo,1+c%nbmemo,1+c%nbmemo,1,1,-1,0));
+  timeCalls(ns[2],decay(ctx,.999,-1));
+  timeCalls(ns[3],interfere(ctx,scratch,itemVectorsInLTM[1+c%nbmemo],.5));
+  timeCalls(ns[4],benchSink+=nearestLTMItem(ctx,itemVectorsInWM[1+c%nbmemo],ctx->nbActiveItems,&distance));
+  timeCalls(ns[5],overlapPattern(ctx,scratch,itemVectorsInWM[1+c%nbmemo]));
+
+  printf("%5d %11d %4d %10.1f",size->nbItemUnits,size->maxDistractors,size->nbop,trialsPerSecond);
+  for(k=0;k<benchKernels;k++)
+    printf(" %9.1f",ns[k]);
+  printf("\n");
+  freeTrialContext(ctx);
+  free(ctx);
+  free(scratch);
+  freePoint(&point);
+}
+
+int checkBenchReference(benchReference *reference,modelParameters *defaults) {
+  // Run a reference point and compare its results with the expected ones, then report the change
+  // of the proportion correct with fast math. Return 1 if the results are the same
+  parameterPoint point,fastPoint;
+  modelParameters q=*defaults;
+  int i,same,fastMath=param_fastMath,precision=param_precision,processing=param_processing;
+  setBenchDimensions(reference->nbItemUnits,90);
+  q.nbop=reference->nbop;
+  initializePoint(&point,&q);
+  initializePoint(&fastPoint,&q);
+  param_fastMath=0;
+  param_precision=precisionFP32;  // the references are in fp32
+  param_processing=reference->processing;
+  runPoints(&point,1,1,reference->nbSimulations,benchSeed);
+  param_fastMath=1;
+  runPoints(&fastPoint,1,1,reference->nbSimulations,benchSeed);
+  param_fastMath=fastMath;
+  param_precision=precision;
+  param_processing=processing;
+  same=point.nbCorrect==reference->nbCorrect;
+  for(i=1;i<=q.nbmemo;i++)
+    same=same && point.serialPositionCount[i]==reference->serialPositionCount[i];
+  printf("units %d nbop %d%s n=%d: proportion correct %1.4f, serial positions",reference->nbItemUnits,reference->nbop,reference->processing==processingAutopilot ? " autopilot" : "",reference->nbSimulations,(float)point.nbCorrect/q.nbmemo/reference->nbSimulations);
+  for(i=1;i<=q.nbmemo;i++)
+    printf(" %1.4f",(float)point.serialPositionCount[i]/reference->nbSimulations);
+  printf(same ? " OK\n" : " CHANGED\n");
+  if (!same) {
+    printf("   expected %ld correct {",reference->nbCorrect);
+    for(i=1;i<=q.nbmemo;i++)
+      printf("%s%ld",i>1 ? "," : "",reference->serialPositionCount[i]);
+    printf("}, got %ld {",point.nbCorrect);
+    for(i=1;i<=q.nbmemo;i++)
+      printf("%s%ld",i>1 ? "," : "",point.serialPositionCount[i]);
+    printf("}\n");
+  }
+  printf("   fast math: proportion correct %1.4f (%+1.4f)\n",(float)fastPoint.nbCorrect/q.nbmemo/reference->nbSimulations,(float)(fastPoint.nbCorrect-point.nbCorrect)/q.nbmemo/reference->nbSimulations);
+  freePoint(&point);
+  freePoint(&fastPoint);
+  return(same);
+}
+
+int runBenchmarks(modelParameters *p,modelParameters *defaults) {
+  // Return EXIT_FAILURE if the results of a reference run have changed
+  int i,k,nbChanged=0;
+  PRESET=itemsRandom;
+  printf("BENCHMARK (seed %d, %d trials and %d calls of each kernel per size)\n",benchSeed,benchTrials,benchCalls);
+  printf("units distractors nbop   trials/s");
+  for(k=0;k<benchKernels;k++)
+    printf(" %9s",benchKernelNames[k]);
+  printf(" (ns/call)\n");
+  for(i=0;i<sizeof(benchSizes)/sizeof(benchSize);i++)
+    benchSizeKernels(&benchSizes[i],p);
+  double error=fastExpError();
+  printf("FAST MATH\nlargest relative error of the exponential on [-%d,0] %.2g (bound %.2g) %s\n",fastExpCheckRange,error,fastExpBound,error<=fastExpBound ? "OK" : "EXCEEDED");
+  nbChanged+=error>fastExpBound;
+  printf("REGRESSION\n");
+  if (maxMemoranda!=benchMemoranda || maxPosition!=benchPositions || param_design) {
+    printf("skipped: the references need %d memoranda and %d positions, and no design\n",benchMemoranda,benchPositions);
+    return(nbChanged ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+  for(i=0;i<sizeof(benchReferences)/sizeof(benchReference);i++)
+    nbChanged+=!checkBenchReference(&benchReferences[i],defaults);
+  return(nbChanged ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+
+/********/
+/* MAIN */
+/********/
+int main(int argc,char* argv[]) {
+
+  int nbSimulations=500;
+  int i,j;
+
+  char *syntax="Syntaxe:\n\
+  ?                  this message\n\
+  -v                 verbose (disabled by default, not available when compiled with -DTBRS_TRACE=0)\n\
+  -q(uiet)           only display statistics, no recall data\n\
+  nbmemo <value>     number of items (default=7)\n\
+  memoDistr <value>  percentage of memo in domain 1 (number of memo in domain 2 is nbmemo-this value)\n\
+  nbop <value>       number of operations (default=4)\n\
+  design <n1,n2,...> Number of operations after each item, cycled over the list (replaces nbop)\n\
+  R <value>          Mean memory processing rate (default=6)\n\
+  P <value>          Proportion of units maintained from each position to the next (default=.3)\n\
+  s <value>          Standard deviation of processing rates (default=1)\n\
+  theta <value>      Retrieval threshold (default=.05)\n\
+  sigma <value>      Standard deviation of Gaussian noise added to item activations at retrieval (default=.02)\n\
+  D <value>          Decay rate (default=.5)\n\
+  Tr <value>         Mean time taken to refresh an item (default=.08)\n\
+  Ta <value>         Mean duration of attentional capture by processing steps (default=.5)\n\
+  freeTime <value>   Free time following each processing step (default=1)\n\
+  ftiod <0 or 1>     Free time can include (1) or not (0) the operation duration (default=1)\n\
+  embeddings <file>  Embeddings of the memoranda, text or binary (default=pca_embeddings_c.txt)\n\
+  memoranda <value>  Number of memoranda in the item layer (default=10)\n\
+  words <w1,w2,...>  Memoranda taken from the rows of these words of a binary embedding file with a vocabulary (default=the first rows)\n\
+  draw <0 or 1>      Draw the memoranda of each trial at random among the words, or all the rows (default=0)\n\
+  distractors <value> Maximum number of distractors in a trial (default=" defaultText(defaultDistractors) ")\n\
+  positions <value>  Number of position representations (default=" defaultText(defaultPositions) ")\n\
+  units <value>      Number of units of the item layer (default=dimensions of a binary embedding file, or " defaultText(defaultItemUnits) ")\n\
+  items <variant>    Memoranda: embeddings, random (patterns on all the units) or classic (on a quarter of the units) (default=" defaultText(defaultItems) ")\n\
+  processing <variant> Processing steps: normal or autopilot (the distractor is encoded at all the positions) (default=normal)\n\
+  dw <value>         Proportion of the encoding rate of the items given to distractors (default=" defaultText(defaultDistractorWeight) ")\n\
+  interference <model> Interference of the distractors: overlap, similar, memoranda (also between memoranda) or classic (TBRS*) (default=" defaultText(defaultInterference) ")\n\
+  interferenceWeight <value> Interference of a new memorandum with the items in WM (interference memoranda) (default=.4)\n\
+  nearest <method>   Search of the closest LTM item: exact, norms or prefix (approximate) (default=exact)\n\
+  prefixDims <value> Number of dimensions used to build the shortlist of the prefix method (default=16)\n\
+  shortlist <value>  Number of items of the shortlist of the prefix method (default=8)\n\
+  determ <seed>      Model is deterministic with the given seed, whatever the number of threads (0 = not deterministic) (default=0)\n\
+  sameDist <0 or 1>  Indicates if distractors are identical (0) or all different (1)\n\
+  threads <value>    Number of worker threads running the replications (default=1, forced to 1 in verbose mode)\n\
+  batch <value>      Number of replications run in lockstep by each worker (default=1, forced to 1 in verbose mode)\n\
+  device <cpu or cuda> Engine running the replications (default=cpu; cuda needs a build with -DTBRS_CUDA)\n\
+  idn <value>        Standard deviation of the noise used to create distractor wrt memorand\n\
+  ido <value>        Item-distractor overlap\n\
+  results <prefix>   Write the recalls in <prefix>.trials.csv and the results of the points in <prefix>.points.csv\n\
+  format <csv or binary> Format of the recalls of the results (default=csv; binary writes <prefix>.trials.bin)\n\
+  events <file>      Record the events of the sampled trials (encoding, refreshing, retrieval, decay...) in a binary file\n\
+  sample <value>     One trial out of value is recorded in the event file (default=1)\n\
+  grid <param> <values> Sweep mode: simulate each value of a model parameter (v1,v2,... or first:last:step).\n\
+                     Several grid parameters give all the combinations of their values\n\
+  points <file>      Sweep mode: simulate the points of a file (a line of parameter names, then one line of values per point)\n\
+  fit <param>[:min:max],... Fit mode: search the values of continuous parameters (R, D, Ta, theta, sigma, ido...)\n\
+                     closest to the target, from their command line values (default bounds 0 and none)\n\
+  target <p1,p2,...> Serial position curve fitted (proportion correct at each position, one per item)\n\
+  fitIterations <value> Maximum number of iterations of the fit (default=200)\n\
+  spanStop <0 or 1>  Stop the list lengths at floor or ceiling after a quarter of the replications (default=1)\n\
+  precision <fp32, bf16, fp16 or int8> Storage of the LTM representations read by the closest LTM item search (default=fp32)\n\
+  validate           Run the point in fp32 and at the precision, and display the change of the results\n\
+  fastMath <0 or 1>  Compute the decay factors and encoding strengths with a polynomial exponential (default=0)\n\
+  profile <0 or 1>   Count and time the phases of the trials, displayed per trial after the results of each point (default=0)\n\
+  shard <i/N>        Sweep mode: only run the i-th of N ranges of the points (1<=i<=N)\n\
+  checkpoint <file>  Sweep mode: save the results in file after each round of replications, and go on from it if it exists\n\
+  checkpointInterval <value> Seconds between two checkpoints (default=60)\n\
+  merge <file1,file2,...> Results of a sweep from the checkpoints of its shards\n\
+  serve <- or path>  Server mode: run the points of the binary requests read from stdin (-) or a Unix socket and write back their results\n\
+  bench              Time the kernels and the trials at several sizes, and check the results of reference runs\n"; 
+  modelParameters defaults=param;   // parameters of the reference runs of the benchmark
+  int benchMode=0;
+  int validateMode=0;
+  char *mergeList=NULL;
+
+  // Analyze command line
+  i=1;
+  while (i<argc) {
+    if (!strcmp(argv[i],"?")) {error(syntax,"");i++;}
+#if TBRS_TRACE
+    else if (!strcmp(argv[i],"-v")) {VERBOSE=1;i++;}
+#else
+    else if (!strcmp(argv[i],"-v")) error("-v is not available in this build,","compile with -DTBRS_TRACE=1");
+#endif
+    else if (!strcmp(argv[i],"-q")) {QUIET=1;i++;}
+    else if (!strcmp(argv[i],"bench")) {benchMode=1;i++;}
+    else if (!strcmp(argv[i],"-n")) {nbSimulations=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"determ")) {param_deterministic=atol(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"threads")) {param_nbThreads=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"batch")) {param_batch=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"device")) {
+      if (!strcmp(argv[i+1],"cpu")) param_device=deviceCPU;
+      else if (!strcmp(argv[i+1],"cuda")) param_device=deviceCUDA;
+      else error("Unknown device: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"design")) {parseDesign(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"precision")) {
+      for(param_precision=precisionInt8;param_precision>=0 && strcmp(argv[i+1],precisionNames[param_precision]);param_precision--);
+      if (param_precision<0)
+	error("Unknown precision: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"validate")) {validateMode=1;i++;}
+    else if (!strcmp(argv[i],"fastMath")) {param_fastMath=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"profile")) {param_profile=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"embeddings")) {embeddingsFileName=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"words")) {memorandaWords=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"draw")) {param_drawMemoranda=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"memoranda")) {maxMemoranda=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"distractors")) {maxDistractors=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"positions")) {maxPosition=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"units")) {nbItemUnits=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"nearest")) {
+      if (!strcmp(argv[i+1],"exact")) param_nearest=nearestExact;
+      else if (!strcmp(argv[i+1],"norms")) param_nearest=nearestNorms;
+      else if (!strcmp(argv[i+1],"prefix")) param_nearest=nearestPrefix;
+      else error("Unknown nearest LTM item method: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"interference")) {
+      for(param_interference=0;param_interference<nbInterferenceModels && strcmp(argv[i+1],interferenceModels[param_interference].name);param_interference++);
+      if (param_interference==nbInterferenceModels)
+	error("Unknown interference model: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"items")) {
+      if (!strcmp(argv[i+1],"embeddings")) PRESET=itemsEmbeddings;
+      else if (!strcmp(argv[i+1],"random")) PRESET=itemsRandom;
+      else if (!strcmp(argv[i+1],"classic")) PRESET=itemsClassic;
+      else error("Unknown memoranda variant: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"processing")) {
+      if (!strcmp(argv[i+1],"normal")) param_processing=processingNormal;
+      else if (!strcmp(argv[i+1],"autopilot")) param_processing=processingAutopilot;
+      else error("Unknown processing variant: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"interferenceWeight")) {param_interferenceWeight=atof(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"prefixDims")) {param_prefixDims=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"shortlist")) {param_shortlist=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"grid")) {
+      if (nbGridParameters==maxGridParameters)
+	error("Too many grid parameters.","");
+      gridNames[nbGridParameters]=argv[i+1];
+      gridValues[nbGridParameters++]=argv[i+2];
+      i+=3;
+    }
+    else if (!strcmp(argv[i],"points")) {pointsFileName=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"shard")) {
+      if (sscanf(argv[i+1],"%d/%d",&param_shard,&param_nbShards)!=2 || param_shard<1 || param_shard>param_nbShards)
+	error("Bad shard (i/N with 1<=i<=N): ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"checkpoint")) {checkpointFileName=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"checkpointInterval")) {param_checkpointInterval=atof(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"merge")) {mergeList=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"serve")) {serverAddress=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"fit")) {parseFitParameters(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"target")) {parseFitTarget(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"spanStop")) {param_spanStop=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"fitIterations")) {param_fitIterations=atoi(argv[i+1]);i+=2;}
+    else if (!strcmp(argv[i],"results")) {resultsPrefix=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"format")) {
+      if (!strcmp(argv[i+1],"csv")) resultFormat=resultFormatCSV;
+      else if (!strcmp(argv[i+1],"binary")) resultFormat=resultFormatBinary;
+      else error("Unknown results format: ",argv[i+1]);
+      i+=2;
+    }
+    else if (!strcmp(argv[i],"events")) {eventsFileName=argv[i+1];i+=2;}
+    else if (!strcmp(argv[i],"sample")) {param_eventSampling=atoi(argv[i+1]);i+=2;}
+    else if (setParameter(&param,argv[i],argv[i+1])) i+=2;
+    else 
+      error("Unknown parameter:",argv[i]);
+  }
+  
+  if (param_nbThreads<1)
+    error("The number of threads should be at least 1.","");
+  if (param_batch<1)
+    error("The size of the batches should be at least 1.","");
+  if (VERBOSE)  // the trace of the lanes would be interleaved
+    param_batch=1;
+  if (param_device==deviceCUDA) {
+#ifndef TBRS_CUDA
+    error("This build has no GPU engine,","compile with -DTBRS_CUDA and link tbrs_cuda.o (see tbrs_cuda.cu)");
+#endif
+    if (VERBOSE || eventsFileName || param_profile)
+      error("The GPU engine has no verbose mode, no event trace and no profile.","");
+    if (param_nearest!=nearestExact)
+      error("The GPU engine only finds the closest LTM item with the exact method.","");
+    if (param_fastMath || param_precision!=precisionFP32)
+      error("The GPU engine has no fast math mode and stores the LTM representations in fp32.","");
+    if (param_drawMemoranda)
+      error("The GPU engine runs all the trials with the same memoranda (no draw).","");
+    if (param_interference!=interferenceOverlap)
+      error("The GPU engine only has the overlap interference model.","");
+    if (PRESET==itemsClassic || param_processing!=processingNormal)
+      error("The GPU engine has no classic memoranda and no autopilot processing.","");
+  }
+
+  if (param_prefixDims<1 || param_shortlist<1)
+    error("The prefix dimensions and the shortlist should be at least 1.","");
+
+  if (param_eventSampling<1)
+    error("The event sampling should be at least 1.","");
+
+  if (param_profile && !TBRS_PROFILE)
+    error("profile is not available in this build,","compile with -DTBRS_PROFILE=1");
+  if (param_profile)
+    startProfile();
+
+  prepareParameters(&param);
+  maxItem=maxMemoranda+maxDistractors;
+
+  if (benchMode) {
+    if (VERBOSE)
+      error("The benchmark cannot be run in verbose mode.","");
+    return(runBenchmarks(&param,&defaults));
+  }
+  if (nbFitParameters>0) {
+    if (fitTarget==NULL)
+      error("The fit mode needs a target.","");
+    if (nbGridParameters>0 || pointsFileName)
+      error("The fit mode cannot be combined with a sweep.","");
+    if (VERBOSE)
+      error("The fit mode cannot be run in verbose mode.","");
+  }
+  if (validateMode && (param_precision==precisionFP32 || VERBOSE || nbFitParameters>0 || nbGridParameters>0 || pointsFileName))
+    error("validate needs a precision other than fp32, and no verbose mode, fit or sweep.","");
+  if ((checkpointFileName || param_nbShards>1) && nbGridParameters==0 && !pointsFileName)
+    error("shard and checkpoint are options of the sweep mode.","");
+  if (param_nbShards>1 && !param_deterministic)  // merge needs the shards of the same random streams
+    error("The shards of a sweep should all be run with the same determ <seed>.","");
+  if (checkpointFileName && eventsFileName)  // recalls and events written after the last checkpoint would be written again
+    error("A checkpointed sweep only keeps the results of the points, not the events.","");
+  if (serverAddress && (VERBOSE || resultsPrefix || eventsFileName || nbFitParameters>0 || validateMode || nbGridParameters>0 || pointsFileName || checkpointFileName || mergeList))
+    error("The server mode only answers its requests: no verbose mode, results or event file, fit, validation or sweep.","");
+
+  // MERGE: the results of the shards of a sweep, nothing is simulated
+  if (mergeList) {
+    if (resultsPrefix)
+      openResults(0);
+    mergeCheckpoints(mergeList);
+    closeResults();
+    return(0);
+  }
+
+  if (VERBOSE)
+    printf("running");
+  if (resultsPrefix) {
+    if (resultFormat==resultFormatText)
+      resultFormat=resultFormatCSV;
+    openResults(checkpointFileName==NULL);
+  }
+  else if (!QUIET && nbFitParameters==0 && !checkpointFileName && !serverAddress) {  // the recalls of the candidates of a fit are only written in a results file
+    resultFormat=resultFormatText;
+    trialsFile=stderr;
+  }
+  if (eventsFileName)
+    openEvents(eventsFileName);
+
+  // READ EMBEDDINGS LIST FROM FILE (once for all the list lengths)
+  // The embeddings give the number of item units unless it is set on the command line
+  if (PRESET==itemsEmbeddings) {
+    loadEmbeddings(&embeddings,embeddingsFileName,memorandaWords ? 1 : maxMemoranda,nbItemUnits);
+    if (nbItemUnits==0)
+      nbItemUnits=embeddings.cols;
+    createMemorandaPool(&embeddings);
+    // Print the array
+    for (i = 0; VERBOSE && !param_drawMemoranda && i < maxMemoranda; i++) {
+      const float *embedding=embeddingRow(&embeddings,memorandaPool[i]);
+      for (j = 0; j < nbItemUnits; j++)
+        printf("%f ", embedding[j]);
+      printf("\n");
+    }
+  }
+  else if (nbItemUnits==0)
+    nbItemUnits=defaultItemUnits;
+  if (nbItemUnits<1)
+    error("The number of item units should be at least 1.","");
+  itemStride=paddedSize(nbItemUnits);
+
+  // SERVER MODE: the points of the requests, until the end of the input
+  if (serverAddress) {
+    runServer(serverAddress);
+    unloadEmbeddings(&embeddings);
+    return(0);
+  }
+
+  // FIT MODE: one line per candidate, then the results of the best one
+  if (nbFitParameters>0) {
+    fitParameters(nbSimulations,param_deterministic ? param_deterministic : time(0));
+    closeResults();
+    unloadEmbeddings(&embeddings);
+    return(0);
+  }
+
+  // VALIDATION: the point in fp32 and at the storage precision
+  if (validateMode) {
+    validatePrecision(nbSimulations,param_deterministic ? param_deterministic : time(0));
+    closeResults();
+    unloadEmbeddings(&embeddings);
+    return(0);
+  }
+
+  // SWEEP MODE: one line of results per point
+  if (nbGridParameters>0 || pointsFileName) {
+    parameterPoint *points;
+    int nbPoints=createSweepPoints(&points),p,first,count;
+    uint64_t seed=param_deterministic ? param_deterministic : time(0);
+    shardRange(nbPoints,&first,&count);
+    nbPointsWritten=first;  // numbers of the points in the recalls
+    if (checkpointFileName)
+      runCheckpointedPoints(points+first,first,count,nbPoints,nbSimulations,&seed);
+    else
+      runPoints(points+first,count,1,nbSimulations,seed);
+    printSweepResults(points+first,first,count,nbSimulations);
+    for(p=0;p<nbPoints;p++)
+      freePoint(&points[p]);
+    free(points);
+    closeResults();
+    unloadEmbeddings(&embeddings);
+    return(0);
+  }
+
+  // SPAN: one block of results per list length
+  if (VERBOSE)
+    printf("%i",param.nbmemo);
+  estimateSpan(nbSimulations,param_deterministic ? param_deterministic : time(0));
+  closeResults();
+  unloadEmbeddings(&embeddings);
 }
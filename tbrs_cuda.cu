@@ -0,0 +1,638 @@
+/*
+  GPU backend of the TBRS* model of tbrs_compatible_with_bert_model.c (device cuda).
+  Each GPU thread runs a whole trial: the threads of a warp are trials in lockstep, and the
+  divergence of their refreshes is masked by the hardware. The matrices of the trials of a launch
+  are in global memory, interleaved (element e of trial t at e*nbTrials+t) so that the accesses
+  of a warp are coalesced. Each trial draws from the xoshiro256** stream of its replication,
+  given by the host, with the same functions and in the same order as the CPU engine.
+  Differences with the CPU engine:
+     - the closest LTM item is always found by the exact method (nearest exact)
+     - single precision functions (expf, logf...) of the device may differ from the host by an
+       ulp, so the results are statistically the same but not bit-identical
+     - no verbose trace and no event trace
+  Build:
+     nvcc -O2 -c tbrs_cuda.cu
+     gcc -O2 -DTBRS_CUDA -pthread -o tbrs tbrs_compatible_with_bert_model.c tbrs_cuda.o -lcudart -lm
+  Without nvcc, "g++ -O2 -x c++ -c tbrs_cuda.cu" builds a host emulation running the device code
+  on the CPU, one trial after the other. It gives the same results as the CPU engine and is used
+  to check the port.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tbrs_cuda.h"
+
+#ifdef __CUDACC__
+#include <cuda_runtime.h>
+#define tbrsDevice __device__
+#else
+#define tbrsDevice
+#define __global__
+#endif
+
+//CONSTANTS (as in tbrs_compatible_with_bert_model.c)
+#define nbUnitBlocks 9
+#define sizeOfPositionBlocks 6
+#define nbPositionUnits (nbUnitBlocks*sizeOfPositionBlocks)
+#define normalBufferSize 64
+#define minDecayLevel 1e-100
+#define abandonBlock 32
+#define threadsPerBlock 128
+
+// TRIALS OF A LAUNCH
+typedef struct {
+  tbrsCudaPoint point;      // schedule and memoranda point to device memory
+  int maxItem;
+  int nbTrials;             // trials of the launch: stride of the interleaved arrays
+  const uint64_t *streams;  // [nbTrials][4]
+  float *itemPositionMatrix;  // [maxItem+1][nbPositionUnits][nbTrials]
+  float *itemVectorsInWM;   // [maxItem+1][nbItemUnits][nbTrials]
+  float *itemVectorsInLTM;  // [maxItem+1][nbItemUnits][nbTrials]
+  double *rowLevels;        // [maxItem+1][nbTrials]
+  int *positionCodes;       // [maxPosition+1][nbUnitBlocks][nbTrials]
+  int *recalled;            // [nbTrials][maxPosition]
+} deviceTrials;
+
+// STATE OF A TRIAL (registers and local memory of its thread)
+typedef struct {
+  const deviceTrials *d;
+  const tbrsCudaPoint *p;
+  int t;                    // trial of the launch
+  uint64_t s[4];            // random stream
+  float normalBuffer[normalBufferSize];
+  int normalIndex;
+  double decayLevel;
+  int nbActiveItems;
+  int distractorNumber;
+  int lastItem;
+  float var_te;
+  float var_tr;
+  float var_eta;
+  float var_rop;
+  float var_ta;
+} trialState;
+
+/************/
+/* MATRICES */
+/************/
+tbrsDevice inline float &association(trialState *st,int item,int unit) {
+  return(st->d->itemPositionMatrix[((size_t)item*nbPositionUnits+unit)*st->d->nbTrials+st->t]);
+}
+
+tbrsDevice inline float &wm(trialState *st,int item,int unit) {
+  return(st->d->itemVectorsInWM[((size_t)item*st->p->nbItemUnits+unit)*st->d->nbTrials+st->t]);
+}
+
+tbrsDevice inline float &ltm(trialState *st,int item,int unit) {
+  return(st->d->itemVectorsInLTM[((size_t)item*st->p->nbItemUnits+unit)*st->d->nbTrials+st->t]);
+}
+
+tbrsDevice inline double &rowLevel(trialState *st,int item) {
+  return(st->d->rowLevels[(size_t)item*st->d->nbTrials+st->t]);
+}
+
+tbrsDevice inline int &positionCode(trialState *st,int position,int block) {
+  return(st->d->positionCodes[((size_t)position*nbUnitBlocks+block)*st->d->nbTrials+st->t]);
+}
+
+tbrsDevice inline int minInt(int val1,int val2) {
+  return(val1<val2 ? val1 : val2);
+}
+
+tbrsDevice inline int maxInt(int val1,int val2) {
+  return(val1>val2 ? val1 : val2);
+}
+
+/************/
+/*  RANDOM  */
+/************/
+tbrsDevice uint64_t rngNext(trialState *st) {
+  // xoshiro256** (see rngNext of the C code)
+  uint64_t *s=st->s;
+  uint64_t result=s[1]*5;
+  result=((result<<7) | (result>>57))*9;
+  uint64_t t=s[1]<<17;
+  s[2]^=s[0];
+  s[3]^=s[1];
+  s[1]^=s[2];
+  s[0]^=s[3];
+  s[2]^=t;
+  s[3]=(s[3]<<45) | (s[3]>>19);
+  return(result);
+}
+
+tbrsDevice float randomUniform(trialState *st) {
+  return((rngNext(st)>>40)*(1.0f/16777216));
+}
+
+tbrsDevice int randomBelow(trialState *st,int n) {
+  return((int)(((rngNext(st)>>32)*(uint64_t)n)>>32));
+}
+
+tbrsDevice float randomNormal(trialState *st,float mean,float std) {
+  // Box-Muller by buffers of normalBufferSize numbers (see fillNormalBuffer of the C code)
+  if (st->normalIndex==normalBufferSize) {
+    int i;
+    for(i=0;i<normalBufferSize/2;i++) {
+      uint64_t bits=rngNext(st);
+      float u=((bits>>40)+1)*(1.0f/16777216);
+      float v=(bits & 0xFFFFFF)*(1.0f/16777216);
+      float radius=sqrtf(-2*logf(u));
+      float angle=2*3.1415926535f*v;
+      st->normalBuffer[2*i]=radius*cosf(angle);
+      st->normalBuffer[2*i+1]=radius*sinf(angle);
+    }
+    st->normalIndex=0;
+  }
+  return(mean+std*st->normalBuffer[st->normalIndex++]);
+}
+
+/************/
+/* PATTERNS */
+/************/
+tbrsDevice void createSimilarRandomPattern(trialState *st,int item,int refItem,float std,int min,int max) {
+  // LTM units min..max of item from the WM units of refItem (see the C code)
+  int i;
+  float val;
+  for(i=min;i<=max;i++) {
+    if (wm(st,refItem,i)==-1)
+      val=randomUniform(st);
+    else {
+      val=randomNormal(st,wm(st,refItem,i),std);
+      if (val<0)
+	val=0;
+      else if (val>1)
+	val=1;
+    }
+    ltm(st,item,i)=val;
+  }
+}
+
+tbrsDevice void createOverlapingRandomPattern(trialState *st,int item,int refItem,int patternSize,float p) {
+  // LTM representation of a distractor from the WM representation of refItem (see the C code):
+  // as many units as refItem has known units from its first one (overlapPattern)
+  int i=0,c,alea,firstUsedUnit,width;
+  float tmp;
+  while (i<patternSize && (int)wm(st,refItem,i)==-1)
+    ltm(st,item,i++)=-1;
+  firstUsedUnit=i;
+  for(width=0;firstUsedUnit+width<patternSize && (int)wm(st,refItem,firstUsedUnit+width)!=-1;width++)
+    ;
+  for(c=1;c<=(1-p)*width && i<patternSize;c++)
+    ltm(st,item,i++)=-1;
+  createSimilarRandomPattern(st,item,refItem,st->p->itemDistractorNoise,i,minInt(i+width,patternSize-1));
+  for(c=minInt(firstUsedUnit+width,patternSize-1);c>firstUsedUnit;c--) {
+    alea=randomBelow(st,minInt(width,patternSize-firstUsedUnit))+firstUsedUnit;
+    tmp=ltm(st,item,alea);
+    ltm(st,item,alea)=ltm(st,item,c);
+    ltm(st,item,c)=tmp;
+  }
+  for(c=i+width+1;c<patternSize;c++)
+    ltm(st,item,c)=-1;
+}
+
+/*********/
+/* DECAY */
+/*********/
+tbrsDevice void resetDecay(trialState *st) {
+  int i;
+  st->decayLevel=1;
+  for(i=0;i<=st->nbActiveItems;i++)
+    rowLevel(st,i)=1;
+}
+
+tbrsDevice float decayScale(trialState *st,int item) {
+  return(st->decayLevel/rowLevel(st,item));
+}
+
+tbrsDevice void updateRow(trialState *st,int item) {
+  int j;
+  if (rowLevel(st,item)!=st->decayLevel) {
+    float factor=decayScale(st,item);
+    for(j=0;j<nbPositionUnits;j++)
+      association(st,item,j)*=factor;
+    rowLevel(st,item)=st->decayLevel;
+  }
+}
+
+tbrsDevice void decay(trialState *st,float factor,int excludedItem) {
+  int i;
+  st->decayLevel*=factor;
+  if (excludedItem!=-1)
+    rowLevel(st,excludedItem)*=factor;
+  if (st->decayLevel<minDecayLevel) {
+    for(i=0;i<=st->nbActiveItems;i++)
+      updateRow(st,i);
+    resetDecay(st);
+  }
+}
+
+tbrsDevice void activateItem(trialState *st,int item) {
+  int j;
+  for(j=0;j<nbPositionUnits;j++)
+    association(st,item,j)=0;
+  rowLevel(st,item)=st->decayLevel;
+  for(j=0;j<st->p->nbItemUnits;j++)
+    ltm(st,item,j)=-1;
+  st->nbActiveItems=item;
+}
+
+tbrsDevice void interfereWithWM(trialState *st,int oldItem,int newItem,float p) {
+  // interfere() of the C code, the new vector being the WM representation of newItem
+  int j;
+  for(j=0;j<st->p->nbItemUnits;j++) {
+    float oldValue=wm(st,oldItem,j),newValue=wm(st,newItem,j);
+    if ((oldValue != newValue) && ((int)oldValue!=-1 && (int)newValue!=-1))
+      wm(st,oldItem,j)=oldValue*(1 -p) + newValue*p;
+  }
+}
+
+tbrsDevice void interfereWithLTM(trialState *st,int oldItem,int newItem,float p) {
+  // interfere() of the C code, the new vector being the LTM representation of newItem
+  int j;
+  for(j=0;j<st->p->nbItemUnits;j++) {
+    float oldValue=wm(st,oldItem,j),newValue=ltm(st,newItem,j);
+    if ((oldValue != newValue) && ((int)oldValue!=-1 && (int)newValue!=-1))
+      wm(st,oldItem,j)=oldValue*(1 -p) + newValue*p;
+  }
+}
+
+/************/
+/* RETRIEVE */
+/************/
+tbrsDevice int nearestLTMItem(trialState *st,int wmItem,int nbItems) {
+  // nearest exact: squared distances with early abandon, the first item wins ties
+  int item,bestItem=0,i;
+  float best=INFINITY;
+  for(item=1;item<=nbItems;item++) {
+    float somme=0,diff;
+    for(i=0;i<st->p->nbItemUnits;i++) {
+      diff=wm(st,wmItem,i)-ltm(st,item,i);
+      somme+=diff*diff;
+      if ((i+1)%abandonBlock==0 && somme>=best)
+	break;
+    }
+    if (somme<best) {
+      best=somme;
+      bestItem=item;
+    }
+  }
+  return(bestItem);
+}
+
+tbrsDevice int retrieve(trialState *st,int pos,int status,float *activationMax,float *retrievalDuration,int *bestWMItem) {
+  const tbrsCudaPoint *p=st->p;
+  int item,k;
+  if (status==0) {
+    float var_r=randomNormal(st,p->R,p->s);
+    if (var_r<.1)
+      var_r=.1;
+    st->var_tr=p->logTauE/var_r;
+    if (st->var_tr > p->presentationTime)
+      st->var_tr=p->presentationTime;
+  }
+  *retrievalDuration=st->var_tr;
+  *activationMax=-99999;
+
+  // the noise is scaled by the integer max() of the C code
+  float noiseScale=maxInt(p->sigma,.0001);
+  int bestActivatedItem=-1;
+  for(item=1;item<=p->maxMemoranda+st->distractorNumber;item++) {
+    float noise=randomNormal(st,0,1);
+    float somme=0;
+    for(k=0;k<nbUnitBlocks;k++)
+      somme+=association(st,item,positionCode(st,pos,k));
+    float weightedNoise=noise*noiseScale;
+    somme=somme*decayScale(st,item)+weightedNoise;
+    if (somme > *activationMax) {
+      *activationMax=somme;
+      bestActivatedItem=item;
+    }
+  }
+  if (bestActivatedItem!=-1)
+    *bestWMItem=bestActivatedItem;
+  if (*activationMax < p->theta)
+    return(0);
+  return(nearestLTMItem(st,*bestWMItem,p->maxMemoranda+st->distractorNumber));
+}
+
+/**********/
+/* ENCODE */
+/**********/
+tbrsDevice float encode(trialState *st,int initialEncoding,int currentItem,int bestWMItem,int position,float timeLeft,int strengthDivisor,float duration,int distractor) {
+  const tbrsCudaPoint *p=st->p;
+  int j,k,retrievedItem,tmp;
+  float encodingDuration,var_r,retrievalDuration,activationMax;
+
+  var_r=randomNormal(st,p->R,p->s);
+  if (var_r<.1)
+    var_r=.1;
+
+  if (initialEncoding) {
+    if (distractor)
+      encodingDuration=0;
+    else {
+      for (j=0;j<p->nbItemUnits;j++)
+	wm(st,currentItem,j)=ltm(st,currentItem,j);
+      st->var_te=p->logTauE/var_r;
+      if (st->var_te > p->presentationTime)
+	st->var_te=p->presentationTime;
+      encodingDuration=st->var_te;
+      st->var_eta=1-exp(-var_r*encodingDuration);
+    }
+  }
+  else {
+    if (duration == -1) {
+      st->var_tr=-log(1-p->tauR)/var_r;
+      if (st->var_tr > timeLeft)
+	st->var_tr=timeLeft;
+      encodingDuration=st->var_tr;
+    }
+    else
+      encodingDuration=duration;
+    st->var_eta=1-exp(-var_r*encodingDuration);
+    st->var_eta/=strengthDivisor;
+  }
+
+  if (!distractor && duration == -1)
+    decay(st,exp(-p->D * encodingDuration),currentItem);
+
+  if (distractor) {
+    retrievedItem=retrieve(st,position,1,&activationMax,&retrievalDuration,&tmp);
+    if (p->sameDist == 1) {
+      if (st->distractorNumber == 0) {
+	st->distractorNumber++;
+	activateItem(st,p->maxMemoranda+st->distractorNumber);
+	createOverlapingRandomPattern(st,p->maxMemoranda+st->distractorNumber,retrievedItem,p->nbItemUnits,p->itemDistractorOverlap);
+      }
+    }
+    else
+      createOverlapingRandomPattern(st,p->maxMemoranda+st->distractorNumber,retrievedItem,p->nbItemUnits,p->itemDistractorOverlap);
+    int distractorItem=p->maxMemoranda+st->distractorNumber;
+    for (j=0;j<p->nbItemUnits;j++)
+      wm(st,distractorItem,j)=ltm(st,distractorItem,j);
+    interfereWithWM(st,retrievedItem,distractorItem,p->distractorWeight);
+    st->var_eta*=p->distractorWeight;
+  }
+
+  updateRow(st,currentItem);
+  for(k=0;k<nbUnitBlocks;k++) {
+    j=positionCode(st,position,k);
+    association(st,currentItem,j)+=(p->L-association(st,currentItem,j))*st->var_eta;
+  }
+
+  if (!initialEncoding && !distractor)
+    interfereWithLTM(st,bestWMItem,currentItem,.5);
+  return(encodingDuration);
+}
+
+/***********/
+/* REFRESH */
+/***********/
+tbrsDevice void refresh(trialState *st,float timeAvailable,int lastPosition) {
+  // Same groups and durations as refreshStep() of the C code
+  int currentPosition=1,cpi,afsi,bestLTMItem,bestWMItem=0;
+  float reencodingDuration,activationMax,retrievalDuration;
+  int focus=minInt(st->p->attentionalFocusSize,lastPosition);
+  while (timeAvailable > 0) {
+    afsi=focus;
+    cpi=currentPosition;
+    reencodingDuration=-1;
+    while (afsi > 0) {
+      bestLTMItem=retrieve(st,cpi,1,&activationMax,&retrievalDuration,&bestWMItem);
+      reencodingDuration=encode(st,0,bestLTMItem,bestWMItem,cpi,timeAvailable,focus,reencodingDuration,0);
+      cpi++;
+      if (cpi > lastPosition)
+	cpi=1;
+      afsi--;
+    }
+    currentPosition=cpi;
+    timeAvailable-=reencodingDuration;
+    if (timeAvailable < 0)
+      timeAvailable=0;
+  }
+}
+
+/**************/
+/* PROCESSING */
+/**************/
+tbrsDevice float processing(trialState *st,int lastPosition) {
+  const tbrsCudaPoint *p=st->p;
+  st->var_rop=randomNormal(st,p->Rop,p->s);
+  if (st->var_rop<.1)
+    st->var_rop=.1;
+  st->var_ta=-log(1-p->tauOp)/st->var_rop;
+  if ((st->var_ta > p->freeTime) && (p->freeTimeIncludesOpDuration==1))
+    st->var_ta=p->freeTime;
+  encode(st,1,p->maxMemoranda+st->distractorNumber,-1,lastPosition,9999,1,st->var_ta,1);
+  decay(st,exp(-p->D*st->var_ta),-1);
+  return(st->var_ta);
+}
+
+/**********/
+/* RECALL */
+/**********/
+tbrsDevice void recall(trialState *st,int lastPosition,int *recalled) {
+  const tbrsCudaPoint *p=st->p;
+  int j,position,codeItem,bestLTMItem,bestWMItem=0;
+  float retrievalDuration,activationMax;
+  for(position=1;position<=lastPosition;position++) {
+    bestLTMItem=retrieve(st,position,0,&activationMax,&retrievalDuration,&bestWMItem);
+    if (retrievalDuration > 5)
+      retrievalDuration=5;
+    decay(st,exp(-p->D*retrievalDuration),-1);
+    if (activationMax > p->theta) {
+      codeItem=bestLTMItem;
+      // response suppression, over the first units of the WM representation as in the C code
+      // (the units past nbItemUnits are the 0 padding of its rows)
+      updateRow(st,bestLTMItem);
+      for(j=0;j<nbPositionUnits && j<p->nbItemUnits;j++)
+	if (wm(st,bestLTMItem,j) != 0)
+	  association(st,bestLTMItem,j)-=p->L*activationMax;
+    }
+    else
+      codeItem=-1;
+    recalled[position-1]=codeItem;
+  }
+}
+
+/*********/
+/* TRIAL */
+/*********/
+tbrsDevice void runTrial(const deviceTrials *d,int t) {
+  // Run trial t of the launch (see runReplications and startTrial of the C code)
+  const tbrsCudaPoint *p=&d->point;
+  trialState state,*st=&state;
+  int i,j,position,lastPosition=0;
+  const tbrsCudaOp *op;
+  st->d=d;
+  st->p=p;
+  st->t=t;
+  for(i=0;i<4;i++)
+    st->s[i]=d->streams[4*(size_t)t+i];
+  st->normalIndex=normalBufferSize;
+  st->var_eta=0;
+  st->var_tr=0;
+
+  // position representations
+  for(i=0;i<nbUnitBlocks;i++)
+    positionCode(st,1,i)=i*sizeOfPositionBlocks+randomBelow(st,sizeOfPositionBlocks);
+  for(position=2;position<=p->maxPosition;position++)
+    for(i=0;i<nbUnitBlocks;i++) {
+      if (randomBelow(st,100)>p->P*100)
+	positionCode(st,position,i)=i*sizeOfPositionBlocks+randomBelow(st,sizeOfPositionBlocks);
+      else
+	positionCode(st,position,i)=positionCode(st,position-1,i);
+    }
+
+  // item representations
+  for(i=1;i<=p->maxMemoranda;i++) {
+    if (p->memoranda==NULL)
+      for(j=0;j<p->nbItemUnits;j++)
+	ltm(st,i,j)=randomUniform(st);
+    else
+      for(j=0;j<p->nbItemUnits;j++)
+	ltm(st,i,j)=p->memoranda[(size_t)(i-1)*p->nbItemUnits+j];
+  }
+
+  for(i=1;i<=p->maxMemoranda;i++)
+    for(j=0;j<nbPositionUnits;j++)
+      association(st,i,j)=0;
+  st->nbActiveItems=p->maxMemoranda;
+  resetDecay(st);
+  st->distractorNumber=0;
+
+  for(op=p->schedule;;op++) {
+    if (op->type==tbrsCudaEncode) {
+      lastPosition=op->position;
+      st->lastItem=op->item;
+      float encodingDuration=encode(st,1,op->item,-1,lastPosition,p->presentationTime,1,-1,0);
+      refresh(st,p->presentationTime-encodingDuration,lastPosition);
+    }
+    else if (op->type==tbrsCudaProcess) {
+      if (p->sameDist == 0) {
+	st->distractorNumber++;
+	activateItem(st,p->maxMemoranda+st->distractorNumber);
+      }
+      float processingDuration=processing(st,lastPosition);
+      float timeLeft;
+      if (p->freeTimeIncludesOpDuration)
+	timeLeft=op->freeTime-processingDuration;
+      else
+	timeLeft=op->freeTime;
+      refresh(st,timeLeft,lastPosition);
+    }
+    else {  // tbrsCudaRecall
+      recall(st,op->position,d->recalled+(size_t)t*p->maxPosition);
+      break;
+    }
+  }
+}
+
+__global__ void trialKernel(deviceTrials d) {
+#ifdef __CUDACC__
+  int t=blockIdx.x*blockDim.x+threadIdx.x;
+  if (t<d.nbTrials)
+    runTrial(&d,t);
+#else
+  int t;
+  for(t=0;t<d.nbTrials;t++)
+    runTrial(&d,t);
+#endif
+}
+
+/********************/
+/* DEVICE MEMORY    */
+/********************/
+#ifdef __CUDACC__
+#define check(call) if ((call)!=cudaSuccess) {failure=cudaGetErrorString(cudaGetLastError()); goto end;}
+#else
+// host emulation: the device memory is host memory
+#define cudaMalloc(pointer,size) ((*(pointer)=calloc(1,size))==NULL)
+#define cudaMemcpy(to,from,size,kind) (memcpy(to,from,size),0)
+#define cudaMemset(pointer,value,size) (memset(pointer,value,size),0)
+#define cudaFree(pointer) free(pointer)
+#define check(call) if (call) {failure="cannot allocate the memory of the trials"; goto end;}
+#endif
+
+#ifdef __CUDACC__
+static size_t trialBytes(const tbrsCudaPoint *point) {
+  // Device memory used by one trial
+  size_t items=point->maxMemoranda+point->maxDistractors+1;
+  return(items*(nbPositionUnits+2*point->nbItemUnits)*sizeof(float)+items*sizeof(double)+(point->maxPosition+1)*nbUnitBlocks*sizeof(int)+sizeof(uint64_t)*4+point->maxPosition*sizeof(int));
+}
+#endif
+
+extern "C" const char *tbrsCudaRunReplications(const tbrsCudaPoint *point,const uint64_t streams[][4],int nbReplications,int *recalled) {
+  deviceTrials d;
+  const char *failure=NULL;
+  size_t items=point->maxMemoranda+point->maxDistractors+1;
+  int first,nbTrials,maxTrials;
+  memset(&d,0,sizeof(d));
+  d.point=*point;
+  d.maxItem=items-1;
+
+  // trials per launch: as many as the device memory holds (a multiple of the warp size)
+#ifdef __CUDACC__
+  size_t freeMemory,totalMemory;
+  if (cudaMemGetInfo(&freeMemory,&totalMemory)!=cudaSuccess)
+    return("no CUDA device");
+  maxTrials=freeMemory/4*3/trialBytes(point);
+  if (maxTrials>=32)
+    maxTrials-=maxTrials%32;
+#else
+  maxTrials=1024;
+#endif
+  if (maxTrials<1)
+    return("not enough device memory for a trial");
+  if (maxTrials>nbReplications)
+    maxTrials=nbReplications;
+
+  {
+    size_t scheduleSize=sizeof(tbrsCudaOp)*point->nbOps;
+    size_t memorandaSize=point->memoranda ? sizeof(float)*point->maxMemoranda*point->nbItemUnits : 0;
+    check(cudaMalloc((void **)&d.point.schedule,scheduleSize));
+    check(cudaMemcpy((void *)d.point.schedule,point->schedule,scheduleSize,cudaMemcpyHostToDevice));
+    if (point->memoranda) {
+      check(cudaMalloc((void **)&d.point.memoranda,memorandaSize));
+      check(cudaMemcpy((void *)d.point.memoranda,point->memoranda,memorandaSize,cudaMemcpyHostToDevice));
+    }
+    check(cudaMalloc((void **)&d.streams,sizeof(uint64_t)*4*maxTrials));
+    check(cudaMalloc((void **)&d.itemPositionMatrix,sizeof(float)*items*nbPositionUnits*maxTrials));
+    check(cudaMalloc((void **)&d.itemVectorsInWM,sizeof(float)*items*point->nbItemUnits*maxTrials));
+    check(cudaMalloc((void **)&d.itemVectorsInLTM,sizeof(float)*items*point->nbItemUnits*maxTrials));
+    check(cudaMalloc((void **)&d.rowLevels,sizeof(double)*items*maxTrials));
+    check(cudaMalloc((void **)&d.positionCodes,sizeof(int)*(point->maxPosition+1)*nbUnitBlocks*maxTrials));
+    check(cudaMalloc((void **)&d.recalled,sizeof(int)*point->maxPosition*maxTrials));
+
+    for(first=0;first<nbReplications;first+=nbTrials) {
+      nbTrials=nbReplications-first<maxTrials ? nbReplications-first : maxTrials;
+      d.nbTrials=nbTrials;
+      // the WM rows start at 0, as in a new context of the CPU engine
+      check(cudaMemset(d.itemVectorsInWM,0,sizeof(float)*items*point->nbItemUnits*nbTrials));
+      check(cudaMemcpy((void *)d.streams,streams[first],sizeof(uint64_t)*4*nbTrials,cudaMemcpyHostToDevice));
+#ifdef __CUDACC__
+      trialKernel<<<(nbTrials+threadsPerBlock-1)/threadsPerBlock,threadsPerBlock>>>(d);
+      check(cudaGetLastError());
+      check(cudaDeviceSynchronize());
+#else
+      trialKernel(d);
+#endif
+      check(cudaMemcpy(recalled+(size_t)first*point->maxPosition,d.recalled,sizeof(int)*point->maxPosition*nbTrials,cudaMemcpyDeviceToHost));
+    }
+  }
+
+ end:
+  cudaFree((void *)d.point.schedule);
+  cudaFree((void *)d.point.memoranda);
+  cudaFree((void *)d.streams);
+  cudaFree(d.itemPositionMatrix);
+  cudaFree(d.itemVectorsInWM);
+  cudaFree(d.itemVectorsInLTM);
+  cudaFree(d.rowLevels);
+  cudaFree(d.positionCodes);
+  cudaFree(d.recalled);
+  return(failure);
+}
@@ -0,0 +1,68 @@
+/*
+  Interface of the GPU backend of tbrs_compatible_with_bert_model.c (see tbrs_cuda.cu).
+  The C code fills a tbrsCudaPoint with the dimensions, the parameters and the schedule of a
+  point, draws the seed stream of each replication and gets back the recalled items.
+*/
+#ifndef TBRS_CUDA_H
+#define TBRS_CUDA_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// OPERATIONS OF THE SCHEDULE (see SCHEDULE in the C code)
+#define tbrsCudaEncode 1
+#define tbrsCudaProcess 2
+#define tbrsCudaRecall 3
+typedef struct {
+  int type;
+  int item;                 // encoded item, or distractor number
+  int position;             // position of the item, or last position encoded
+  float freeTime;
+} tbrsCudaOp;
+
+typedef struct {
+  // DIMENSIONS
+  int maxPosition;
+  int maxMemoranda;
+  int maxDistractors;
+  int nbItemUnits;
+  // MODEL PARAMETERS (see modelParameters)
+  float P;
+  float R;
+  float s;
+  float L;
+  float theta;
+  float sigma;
+  float D;
+  float tauOp;
+  float freeTime;
+  int freeTimeIncludesOpDuration;
+  int attentionalFocusSize;
+  int nbmemo;
+  float presentationTime;
+  float itemDistractorOverlap;
+  float itemDistractorNoise;
+  int sameDist;
+  float distractorWeight;   // proportion of encoding rate for distractors compared to items
+  float logTauE;
+  float tauR;
+  float Rop;
+  // SCHEDULE AND ITEMS
+  const tbrsCudaOp *schedule; // operations of a trial, the last one being the recall
+  int nbOps;
+  const float *memoranda;   // [maxMemoranda][nbItemUnits] LTM representations of the memoranda, NULL for random patterns
+} tbrsCudaPoint;
+
+// Run one trial per stream (the xoshiro256** state of each replication) and write the items
+// recalled by trial r at recalled+r*maxPosition (-1 for none). Return NULL, or a message if the
+// GPU failed
+const char *tbrsCudaRunReplications(const tbrsCudaPoint *point,const uint64_t streams[][4],int nbReplications,int *recalled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif